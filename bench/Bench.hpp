@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace argon::bench {
+
+inline volatile uint64_t g_sink = 0;
+
+// Keeps the compiler from optimizing away the code that produced `value`
+inline void keep(uint64_t value) {
+    g_sink = g_sink + value;
+}
+
+// Runs `func` `iterations` times, returns the average time of one call in nanoseconds
+template <typename F>
+double measure(size_t iterations, F&& func) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        func(i);
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+// Same random sequence on every run, so that results can be compared between builds
+inline std::mt19937_64& rng() {
+    static std::mt19937_64 engine{0x25ea8834};
+    return engine;
+}
+
+inline std::string serverUrl(size_t index) {
+    return "https://server" + std::to_string(index) + ".example.com";
+}
+
+void runIndexBench();
+void runLockBench();
+void runReaderBench();
+
+}
@@ -0,0 +1,77 @@
+#include "Bench.hpp"
+#include "../src/MemoryTokenBackend.hpp"
+#include "../src/TokenIndex.hpp"
+
+#include <algorithm>
+
+namespace argon::bench {
+
+static constexpr size_t SERVERS = 4;
+static constexpr size_t ITERATIONS = 1'000'000;
+
+static StoredToken makeToken(size_t i) {
+    int accountId = static_cast<int>(i / SERVERS) + 1;
+
+    return StoredToken {
+        .url = serverUrl(i % SERVERS),
+        .accountId = accountId,
+        .userId = accountId + 1000,
+        .name = "user" + std::to_string(accountId),
+        .ident = "ident",
+        .token = std::string(64, 'a' + i % 26),
+    };
+}
+
+// Lookup, upsert and erase latency should stay flat as the index grows
+void runIndexBench() {
+    std::printf("%10s %12s %12s %12s %12s\n", "entries", "find ns", "upsert ns", "erase ns", "backend ns");
+
+    for (size_t entries : {10, 100, 1'000, 10'000, 100'000}) {
+        std::vector<StoredToken> tokens;
+        tokens.reserve(entries);
+        for (size_t i = 0; i < entries; i++) {
+            tokens.push_back(makeToken(i));
+        }
+
+        TokenIndex index;
+        MemoryTokenBackend backend;
+        for (auto& token : tokens) {
+            index.upsert(token);
+            (void) backend.upsert({token.url, token.accountId, token.userId}, token.name, token.ident, token.token);
+        }
+
+        // random access order, so that the results don't depend on the insertion order
+        std::vector<const StoredToken*> order;
+        order.reserve(entries);
+        for (auto& token : tokens) {
+            order.push_back(&token);
+        }
+        std::ranges::shuffle(order, rng());
+
+        auto find = measure(ITERATIONS, [&](size_t i) {
+            auto token = order[i % entries];
+            keep(index.find({token->url, token->accountId, token->userId}) != nullptr);
+        });
+
+        auto upsert = measure(ITERATIONS, [&](size_t i) {
+            auto& token = tokens[i % entries];
+            keep(index.upsert(token));
+        });
+
+        // erasing and inserting back keeps the size constant
+        auto erase = measure(ITERATIONS, [&](size_t i) {
+            auto& token = tokens[i % entries];
+            keep(index.erase({token.url, token.accountId, token.userId}));
+            index.upsert(token);
+        });
+
+        auto backendGet = measure(ITERATIONS, [&](size_t i) {
+            auto token = order[i % entries];
+            keep(backend.get({token->url, token->accountId, token->userId}, token->name).has_value());
+        });
+
+        std::printf("%10zu %12.1f %12.1f %12.1f %12.1f\n", entries, find, upsert, erase, backendGet);
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+#include "Bench.hpp"
+#include "../src/MemoryTokenBackend.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+namespace argon::bench {
+
+static constexpr size_t TOKENS = 1'000;
+static constexpr auto DURATION = std::chrono::milliseconds(500);
+
+// Reads per second with `threads` readers, each holding `lock` (through `Guard`) around every lookup like
+// `ArgonState::acquireConfigReadLock` does. A single writer stores a token every millisecond under an exclusive lock
+template <typename Guard, typename Mutex>
+static double readThroughput(Mutex& lock, MemoryTokenBackend& backend, size_t threads) {
+    auto url = serverUrl(0);
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> reads = 0;
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            uint64_t local = 0;
+            size_t i = t;
+
+            while (!stop.load(std::memory_order::relaxed)) {
+                int accountId = static_cast<int>(i++ % TOKENS) + 1;
+
+                Guard guard(lock);
+                keep(backend.get({url, accountId, accountId}, "user").has_value());
+                local++;
+            }
+
+            reads += local;
+        });
+    }
+
+    workers.emplace_back([&] {
+        int accountId = 0;
+
+        while (!stop.load(std::memory_order::relaxed)) {
+            {
+                std::unique_lock guard(lock);
+                accountId = accountId % TOKENS + 1;
+                (void) backend.upsert({url, accountId, accountId}, "user", "ident", "token");
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::this_thread::sleep_for(DURATION);
+    stop = true;
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return reads.load() / std::chrono::duration<double>(DURATION).count();
+}
+
+// Read throughput should scale with the amount of threads with the reader-writer lock, and stay flat with the legacy mutex
+void runLockBench() {
+    MemoryTokenBackend backend;
+    for (int i = 1; i <= static_cast<int>(TOKENS); i++) {
+        (void) backend.upsert({serverUrl(0), i, i}, "user", "ident", "token");
+    }
+
+    std::mutex legacy;
+    std::shared_mutex rw;
+
+    std::printf("%8s %16s %16s\n", "threads", "mutex reads/s", "rwlock reads/s");
+
+    size_t maxThreads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        auto exclusive = readThroughput<std::unique_lock<std::mutex>>(legacy, backend, threads);
+        auto shared = readThroughput<std::shared_lock<std::shared_mutex>>(rw, backend, threads);
+
+        std::printf("%8zu %16.0f %16.0f\n", threads, exclusive, shared);
+    }
+}
+
+}
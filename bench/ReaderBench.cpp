@@ -0,0 +1,79 @@
+#include "Bench.hpp"
+#include "../src/TokenFileReader.hpp"
+
+#include <matjson.hpp>
+
+namespace argon::bench {
+
+// Same layout as the files written by `FileTokenBackend`
+static std::string makeFile(size_t entries) {
+    std::string out = R"({"_ver": 1, "tokens": [)";
+
+    for (size_t i = 0; i < entries; i++) {
+        if (i != 0) out += ", ";
+
+        auto id = std::to_string(i + 1);
+        out += R"({"url": ")" + serverUrl(i % 4) + R"(", "accid": )" + id + R"(, "userid": )" + id
+            + R"(, "name": "user)" + id + R"(", "ident": "ident", "token": ")" + std::string(64, 'a' + i % 26)
+            + R"(", "created": 1700000000, "lastUsed": 1700000000})";
+    }
+
+    out += "]}";
+    return out;
+}
+
+// How the storage was searched before the streaming reader, parse the whole file and scan the array
+static bool findWithDom(std::string_view data, TokenKeyView key) {
+    auto parsed = matjson::parse(data);
+    if (!parsed) return false;
+
+    auto value = std::move(parsed).unwrap();
+    for (auto& entry : value["tokens"].asArray().unwrap()) {
+        if (
+            entry["accid"].asInt().unwrapOrDefault() == key.accountId
+            && entry["userid"].asInt().unwrapOrDefault() == key.userId
+            && entry["url"].asString().unwrapOrDefault() == key.url
+        ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Cold single token lookups, the key is in the middle of the file so both paths scan half of it on average
+void runReaderBench() {
+    std::printf("%10s %14s %14s %14s %14s\n", "entries", "stream us", "stream MB/s", "dom us", "dom MB/s");
+
+    for (size_t entries : {10, 100, 1'000, 10'000}) {
+        auto data = makeFile(entries);
+
+        auto url = serverUrl((entries / 2) % 4);
+        int id = static_cast<int>(entries / 2) + 1;
+        TokenKeyView key{url, id, id};
+
+        // roughly the same amount of bytes for every size
+        size_t iterations = std::max<size_t>(20, 200'000'000 / data.size());
+
+        auto stream = measure(iterations, [&](size_t) {
+            auto found = TokenFileReader::find(data, key);
+            keep(found && found.unwrap().has_value());
+        });
+
+        auto dom = measure(iterations, [&](size_t) {
+            keep(findWithDom(data, key));
+        });
+
+        // the streaming reader stops at the match, but throughput is reported over the whole file for both
+        auto mbps = [&](double ns) {
+            return data.size() / ns * 1e9 / (1024 * 1024);
+        };
+
+        std::printf(
+            "%10zu %14.1f %14.1f %14.1f %14.1f\n",
+            entries, stream / 1000.0, mbps(stream), dom / 1000.0, mbps(dom)
+        );
+    }
+}
+
+}
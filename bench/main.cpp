@@ -0,0 +1,33 @@
+#include "Bench.hpp"
+
+#include <cstring>
+
+using namespace argon::bench;
+
+// Usage: argon-bench [name], runs every benchmark if no name is given
+int main(int argc, char** argv) {
+    struct Bench {
+        const char* name;
+        void(*run)();
+    };
+
+    Bench benches[] = {
+        {"index", &runIndexBench},
+        {"locks", &runLockBench},
+        {"reader", &runReaderBench},
+    };
+
+    bool any = false;
+    for (auto& bench : benches) {
+        if (argc > 1 && std::strcmp(argv[1], bench.name) != 0) continue;
+
+        std::printf("== %s\n", bench.name);
+        bench.run();
+        any = true;
+    }
+
+    if (!any) {
+        std::printf("unknown benchmark '%s'\n", argv[1]);
+        return 1;
+    }
+}
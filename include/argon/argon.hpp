@@ -3,7 +3,14 @@
 #include <Geode/Result.hpp>
 #include <Geode/utils/web.hpp>
 #include <Geode/utils/function.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
 namespace argon {
     struct AccountData {
@@ -55,10 +62,140 @@ namespace argon {
     using AuthProgressCallback = geode::Function<void(AuthProgress)>;
     using AuthFuture = arc::Future<geode::Result<std::string>>;
 
+    // Detailed progress of an authentication attempt. Besides every `AuthProgress` change,
+    // one is also sent for every round of polling the server while it verifies the solution.
+    struct AuthProgressEvent {
+        AuthProgress progress;
+        // when this event happened, on a monotonic clock
+        std::chrono::steady_clock::time_point timestamp;
+        // time spent in the previous stage, or in the previous round when polling
+        std::chrono::milliseconds previousStageTime{};
+        // verification polls done so far, not counting the first verification request
+        uint32_t pollCount = 0;
+        // how long the server asked to wait before polling again, if it did
+        std::optional<uint32_t> pollAfterMs;
+    };
+
+    // Time spent in each stage of an authentication attempt, stages that were not reached are zero.
+    struct AuthTimings {
+        // waiting for other attempts to make room, see `AuthPriority`
+        std::chrono::milliseconds queued{};
+        std::chrono::milliseconds challengeStart{};
+        // solving the challenge and sending the solution, e.g. uploading the GD message
+        std::chrono::milliseconds solutionSubmit{};
+        std::chrono::milliseconds firstVerify{};
+        // every poll round after the first verification, including the waits in between
+        std::chrono::milliseconds polling{};
+        // the whole `startAuth` call
+        std::chrono::milliseconds total{};
+        uint32_t pollCount = 0;
+        // the token was already stored, no attempt was made
+        bool cached = false;
+        // this call waited on an attempt started by another call. Its stages are reported if it ran in this mod,
+        // otherwise they are zero
+        bool shared = false;
+    };
+
+    using AuthProgressEventCallback = geode::Function<void(const AuthProgressEvent&)>;
+    using AuthTimingsCallback = geode::Function<void(const AuthTimings&)>;
+
+    // Decides which authentication goes first when several are waiting, e.g. when many mods start up at once.
+    // Attempts that wait for long enough are eventually let through regardless of their priority.
+    enum class AuthPriority {
+        // refreshing a token without anyone waiting for it
+        Background = -1,
+        Normal = 0,
+        // the user is waiting for this one, e.g. after pressing a login button
+        Interactive = 1,
+    };
+
+    // Lets the caller abort an authentication attempt, e.g. when the user closes the layer that started it.
+    // Copies share their state, so keep one and pass a copy in `AuthOptions`. Thread-safe.
+    class CancellationToken {
+    public:
+        // A token that can never be cancelled
+        CancellationToken() = default;
+
+        static CancellationToken create() {
+            CancellationToken out;
+            out.m_state = std::make_shared<State>();
+            return out;
+        }
+
+        void cancel() const {
+            if (!m_state || m_state->cancelled.exchange(true, std::memory_order::acq_rel)) return;
+
+            // called outside the lock, so that a callback can't deadlock with `onCancel` / `removeCallback`
+            std::vector<std::pair<uint64_t, geode::Function<void()>>> callbacks;
+            {
+                std::lock_guard lock(m_state->mutex);
+                callbacks.swap(m_state->callbacks);
+            }
+
+            for (auto& [_, callback] : callbacks) {
+                callback();
+            }
+        }
+
+        bool isCancelled() const {
+            return m_state && m_state->cancelled.load(std::memory_order::acquire);
+        }
+
+        // Whether this token can be cancelled at all
+        explicit operator bool() const {
+            return m_state != nullptr;
+        }
+
+        // Calls `callback` once cancelled (right away if it already is), on the thread that cancels.
+        // Returns an ID for `removeCallback`, or 0 if the callback will never be called.
+        // A callback that is being called while it's removed still runs to completion
+        uint64_t onCancel(geode::Function<void()> callback) const {
+            if (!m_state) return 0;
+
+            {
+                std::lock_guard lock(m_state->mutex);
+                if (!m_state->cancelled.load(std::memory_order::acquire)) {
+                    uint64_t id = ++m_state->nextCallbackId;
+                    m_state->callbacks.emplace_back(id, std::move(callback));
+                    return id;
+                }
+            }
+
+            callback();
+            return 0;
+        }
+
+        void removeCallback(uint64_t id) const {
+            if (!m_state || id == 0) return;
+
+            std::lock_guard lock(m_state->mutex);
+            std::erase_if(m_state->callbacks, [&](auto& entry) {
+                return entry.first == id;
+            });
+        }
+
+    private:
+        struct State {
+            std::atomic<bool> cancelled = false;
+            std::mutex mutex;
+            uint64_t nextCallbackId = 0;
+            std::vector<std::pair<uint64_t, geode::Function<void()>>> callbacks;
+        };
+
+        std::shared_ptr<State> m_state;
+    };
+
     struct AuthOptions  {
         AuthProgressCallback progress;
         AccountData account;
         bool forceStrong = false;
+        AuthPriority priority = AuthPriority::Normal;
+        // once cancelled, the future resolves to an error right away and any running request is aborted
+        CancellationToken cancellation;
+        // called alongside `progress`, with timing details
+        AuthProgressEventCallback progressEvent;
+        // called once the attempt is over, whether it succeeded or not
+        AuthTimingsCallback timings;
     };
 
     // Returns a future that will start authentication and return the authtoken once completed.
@@ -66,6 +203,8 @@ namespace argon {
     AuthFuture startAuth(AccountData data = getGameAccountData());
 
     // Returns a future that will start authentication and return the authtoken once completed.
+    // If another call is already authenticating the same account on the same server, this one waits for it and returns
+    // the same result instead of starting a second attempt, its progress callback is fed from that attempt.
     AuthFuture startAuth(AuthOptions options);
 
     /* Managing tokens */
@@ -86,11 +225,128 @@ namespace argon {
     // Only tokens generated with the same server URL are deleted. Thread-safe.
     void clearToken(const AccountData& account);
 
+    // Clears all authtokens from the storage for each of these accounts, in a single storage update.
+    // Only tokens generated with the same server URL are deleted. Thread-safe.
+    void clearTokens(std::span<const int> accountIds);
+
+    // Clears all authtokens from the storage for each of these accounts, in a single storage update.
+    // Only tokens generated with the same server URL are deleted. Thread-safe.
+    void clearTokens(std::span<const AccountData> accounts);
+
+    enum class StorageBackend {
+        // JSON file in the mods save directory, shared with all other mods that use Argon. This is the default.
+        // The file is managed by the copy of Argon of whichever mod loads first, so build options like
+        // `ARGON_BINARY_STORE` only take effect if that is your mod.
+        File,
+        // Nothing is read from or written to disk, all tokens are lost when the game closes.
+        Memory,
+    };
+
+    // Switches the storage used for authtokens. Tokens stored with `Memory` are private to your mod
+    // and are not carried over when switching back to `File`.
+    // Mostly intended for tests and benchmarks. Thread-safe.
+    void setStorageBackend(StorageBackend backend);
+
+    struct StorageMetrics {
+        // logical changes, e.g. a stored token or a cleared account
+        uint64_t mutations = 0;
+        // physical writes, every flush writes all changes made since the previous one at once
+        uint64_t commits = 0;
+        // bytes written to disk, including full rewrites of the storage
+        uint64_t bytesWritten = 0;
+
+        double bytesPerMutation() const {
+            return mutations == 0 ? 0.0 : static_cast<double>(bytesWritten) / mutations;
+        }
+    };
+
+    // Returns write statistics of the token storage, which is shared by all mods using Argon. Thread-safe.
+    StorageMetrics getStorageMetrics();
+
+    // Blocks until all changes to the token storage are written to disk. Changes are otherwise written
+    // in the background shortly after they are made, and when the game is closed. Thread-safe.
+    void flushTokens();
+
     // Checks if there's an authtoken stored for the currently used GD account.
     // Not thread-safe, for thread safety use `(const AccountData&)` overload.
     bool hasToken();
 
     // Checks if there's an authtoken stored for this account, thread-safe.
     // If this returns true, all auth functions will likely immediately return success.
+    // Before Argon is loaded, calls from threads other than the main one don't wait for the storage and return false.
     bool hasToken(const AccountData& account);
+
+    // Checks which of these accounts have an authtoken stored, thread-safe.
+    // Much cheaper than calling `hasToken` for each account, the storage is only locked and read once.
+    // The result has one entry for each account, in the same order.
+    std::vector<bool> hasTokens(std::span<const AccountData> accounts);
+
+    // Returns the stored authtoken of each of these accounts, or `std::nullopt` if there is none. Thread-safe.
+    // The result has one entry for each account, in the same order.
+    std::vector<std::optional<std::string>> getTokens(std::span<const AccountData> accounts);
+
+    /* Lock statistics */
+
+    // Storage operations that take the config lock, which is shared by all mods using Argon
+    enum class LockSite : uint8_t {
+        // token lookups
+        Get,
+        // storing a token or updating its last use time
+        Store,
+        // clearing tokens
+        Clear,
+        // writing changes to disk, done in the background
+        Flush,
+        // loading the storage ahead of time, done in the background
+        Load,
+        Other,
+    };
+
+    constexpr size_t LOCK_SITE_COUNT = 6;
+    // bucket `i` counts durations of [2^i, 2^(i+1)) microseconds, the first bucket also counts anything shorter
+    // and the last bucket anything longer
+    constexpr size_t LOCK_HISTOGRAM_BUCKETS = 16;
+    constexpr size_t LOCK_WORST_HOLDS = 8;
+
+    struct LockSiteStats {
+        uint64_t acquisitions = 0;
+        // acquisitions that had to wait for someone else to release the lock
+        uint64_t contended = 0;
+        uint64_t totalWaitNs = 0;
+        uint64_t totalHoldNs = 0;
+        uint64_t maxWaitNs = 0;
+        uint64_t maxHoldNs = 0;
+        uint64_t waitHistogram[LOCK_HISTOGRAM_BUCKETS] = {};
+        uint64_t holdHistogram[LOCK_HISTOGRAM_BUCKETS] = {};
+    };
+
+    struct LockHold {
+        LockSite site = LockSite::Other;
+        // whether the lock was held for writing, readers don't block each other
+        bool exclusive = false;
+        uint64_t waitNs = 0;
+        uint64_t holdNs = 0;
+        // ID of the mod whose copy of Argon took the lock and the name of the thread, truncated if too long
+        char modId[64] = {};
+        char thread[32] = {};
+    };
+
+    struct LockStats {
+        // indexed by `LockSite`
+        LockSiteStats sites[LOCK_SITE_COUNT];
+        // the longest holds, longest first
+        LockHold worst[LOCK_WORST_HOLDS];
+        size_t worstCount = 0;
+    };
+
+    // Enables or disables recording of config lock statistics. Statistics are shared by all mods using Argon,
+    // so enabling them once covers every mod. Disabled by default, as it adds a few clock reads to every storage operation.
+    // Older Argon versions that don't know about this are not recorded. Thread-safe.
+    void setLockInstrumentation(bool enabled);
+
+    // Returns the lock statistics recorded since they were last reset. Thread-safe.
+    LockStats getLockStats();
+
+    // Clears all recorded lock statistics. Thread-safe.
+    void resetLockStats();
 }
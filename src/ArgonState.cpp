@@ -2,6 +2,9 @@
 #include "Web.hpp"
 #include "ArgonStorage.hpp"
 #include <Geode/binding/GameManager.hpp>
+#include <Geode/loader/Loader.hpp>
+#include <Geode/utils/thread.hpp>
+#include <thread>
 
 using enum std::memory_order;
 
@@ -12,28 +15,39 @@ ArgonState::ArgonState() {
 }
 
 void ArgonState::setServerUrl(std::string url) {
-    auto lock = m_serverUrl.lock();
-
-    *lock = std::move(url);
-
     // Strip trailing slash
-    while (!lock->empty() && lock->back() == '/') {
-        lock->pop_back();
+    while (!url.empty() && url.back() == '/') {
+        url.pop_back();
     }
+
+    // mods tend to set the url on every load, which must not pile up snapshots
+    auto current = m_serverConfig.load();
+    if (current && current->url == url) {
+        return;
+    }
+
+    m_serverConfig.publish(std::make_unique<ServerConfig>(ServerConfig {
+        .url = url,
+        .challengeStartUrl = fmt::format("{}/v1/challenge/start", url),
+        .challengeVerifyUrl = fmt::format("{}/v1/challenge/verify", url),
+        .challengeVerifyPollUrl = fmt::format("{}/v1/challenge/verifypoll", url),
+    }));
 }
 
 std::string ArgonState::getServerUrl() const {
-    return *m_serverUrl.lock();
+    return std::string{this->serverUrl()};
 }
 
-std::string ArgonState::makeUrl(std::string_view suffix) const {
-    while (suffix.starts_with('/')) {
-        suffix.remove_prefix(1);
-    }
+std::string_view ArgonState::serverUrl() const {
+    return this->serverConfig().url;
+}
 
-    return fmt::format("{}/{}", getServerUrl(), suffix);
+const ServerConfig& ArgonState::serverConfig() const {
+    // always set, the constructor sets the default url
+    return *m_serverConfig.load();
 }
 
+
 void ArgonState::setCertVerification(bool state) {
     m_certVerification = state;
 }
@@ -42,23 +56,117 @@ bool ArgonState::getCertVerification() const {
     return m_certVerification.load();
 }
 
-std::lock_guard<std::mutex> ArgonState::acquireConfigLock() {
-    auto ptr = m_configLock.load(acquire);
+// Locks `lock`, returns whether it had to wait for another holder
+template <typename L>
+static bool lockCounted(L& lock) {
+    if (lock.try_lock()) {
+        return false;
+    }
 
-    if (!ptr) {
-        this->initConfigLock();
-        ptr = m_configLock.load(acquire);
+    lock.lock();
+    return true;
+}
+
+ConfigWriteLock ArgonState::acquireConfigLock(LockSite site) {
+    auto& rwMutex = *m_configRwLock.load(acquire);
+    auto& legacyMutex = *m_configLock.load(acquire);
+    auto stats = m_lockStats.load(acquire);
+
+    if (!stats->enabled()) {
+        // always lock in this order to avoid deadlocks
+        return ConfigWriteLock {
+            .rw = std::unique_lock(rwMutex),
+            .legacy = std::unique_lock(legacyMutex),
+        };
     }
 
-    return std::lock_guard(*ptr);
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_lock rw(rwMutex, std::defer_lock);
+    std::unique_lock legacy(legacyMutex, std::defer_lock);
+    bool contended = lockCounted(rw);
+    contended |= lockCounted(legacy);
+
+    return ConfigWriteLock {
+        .timer = LockHoldTimer(stats, site, true, contended, start),
+        .rw = std::move(rw),
+        .legacy = std::move(legacy),
+    };
 }
 
-void ArgonState::initConfigLock() {
-    if (m_configLock.load(acquire)) return;
+ConfigWriteLock ArgonState::acquireCacheLock(LockSite site) {
+    auto& rwMutex = *m_configRwLock.load(acquire);
+    auto stats = m_lockStats.load(acquire);
+
+    if (!stats->enabled()) {
+        return ConfigWriteLock {
+            .rw = std::unique_lock(rwMutex),
+        };
+    }
+
+    auto start = std::chrono::steady_clock::now();
 
-    // note: this function is horrible and really has to be thread safe :)
+    std::unique_lock rw(rwMutex, std::defer_lock);
+    bool contended = lockCounted(rw);
+
+    return ConfigWriteLock {
+        .timer = LockHoldTimer(stats, site, true, contended, start),
+        .rw = std::move(rw),
+    };
+}
+
+ConfigReadLock ArgonState::acquireConfigReadLock(LockSite site) {
+    auto& rwMutex = *m_configRwLock.load(acquire);
+    auto stats = m_lockStats.load(acquire);
+
+    if (!stats->enabled()) {
+        return ConfigReadLock {
+            .rw = std::shared_lock(rwMutex),
+        };
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::shared_lock rw(rwMutex, std::defer_lock);
+    bool contended = lockCounted(rw);
+
+    return ConfigReadLock {
+        .timer = LockHoldTimer(stats, site, false, contended, start),
+        .rw = std::move(rw),
+    };
+}
+
+SharedLockStatsV1& ArgonState::lockStats() {
+    return *m_lockStats.load(acquire);
+}
+
+SharedAuthRegistryV1& ArgonState::authRegistry() {
+    return *m_authRegistry.load(acquire);
+}
+
+SharedAuthSchedulerV1& ArgonState::authScheduler() {
+    return *m_authScheduler.load(acquire);
+}
+
+SharedStorageGenerationV1& ArgonState::storageGeneration() {
+    return *m_storageGeneration.load(acquire);
+}
+
+void ArgonState::initConfigLock() {
+    // the main thread is the only one that touches the user objects, which is what makes the lookup and
+    // the creation below atomic across all Argon copies. the flag only keeps out a second call of this copy,
+    // e.g. from a thread that was wrongly taken for the main one
+    bool expected = false;
+    if (!m_configLockBootstrapping.compare_exchange_strong(expected, true, acq_rel)) {
+        return;
+    }
 
     static const std::string LOCK_KEY = "dankmeme.argon/_config_lock_v2_25ea8834";
+    static const std::string RW_LOCK_KEY = "dankmeme.argon/_config_rwlock_v1_25ea8834";
+    static const std::string LOCK_STATS_KEY = "dankmeme.argon/_config_lock_stats_v1_25ea8834";
+    static const std::string AUTH_REGISTRY_KEY = "dankmeme.argon/_auth_registry_v1_25ea8834";
+    static const std::string AUTH_SCHEDULER_KEY = "dankmeme.argon/_auth_scheduler_v1_25ea8834";
+    static const std::string STORAGE_GENERATION_KEY = "dankmeme.argon/_storage_generation_v1_25ea8834";
 
     auto gm = GameManager::get();
 
@@ -68,29 +176,105 @@ void ArgonState::initConfigLock() {
         gm->setUserObject(LOCK_KEY, lockobj);
     }
 
+    auto rwlockobj = geode::cast::typeinfo_cast<CCSharedMutex*>(gm->getUserObject(RW_LOCK_KEY));
+    if (!rwlockobj) {
+        rwlockobj = CCSharedMutex::create();
+        gm->setUserObject(RW_LOCK_KEY, rwlockobj);
+    }
+
+    auto statsobj = geode::cast::typeinfo_cast<SharedLockStatsV1*>(gm->getUserObject(LOCK_STATS_KEY));
+    if (!statsobj) {
+        statsobj = LockStatsRecorder::create();
+        gm->setUserObject(LOCK_STATS_KEY, statsobj);
+    }
+
+    auto registryobj = geode::cast::typeinfo_cast<SharedAuthRegistryV1*>(gm->getUserObject(AUTH_REGISTRY_KEY));
+    if (!registryobj) {
+        registryobj = AuthRegistry::create();
+        gm->setUserObject(AUTH_REGISTRY_KEY, registryobj);
+    }
+
+    auto schedulerobj = geode::cast::typeinfo_cast<SharedAuthSchedulerV1*>(gm->getUserObject(AUTH_SCHEDULER_KEY));
+    if (!schedulerobj) {
+        schedulerobj = AuthScheduler::create();
+        gm->setUserObject(AUTH_SCHEDULER_KEY, schedulerobj);
+    }
+
+    auto generationobj = geode::cast::typeinfo_cast<SharedStorageGenerationV1*>(gm->getUserObject(STORAGE_GENERATION_KEY));
+    if (!generationobj) {
+        generationobj = StorageGeneration::create();
+        gm->setUserObject(STORAGE_GENERATION_KEY, generationobj);
+    }
+
+    m_lockStats.store(statsobj, release);
+    m_authRegistry.store(registryobj, release);
+    m_authScheduler.store(schedulerobj, release);
+    m_storageGeneration.store(generationobj, release);
     m_configLock.store(&lockobj->data(), release);
+    // stored last, as this is what `isConfigLockInitialized` checks
+    m_configRwLock.store(&rwlockobj->data(), release);
+
+    // the token cache is shared the same way, this is the earliest point where we can do it
+    ArgonStorage::get().initSharedCache();
+}
+
+bool ArgonState::ensureConfigLock() {
+    if (this->isConfigLockInitialized()) {
+        return true;
+    }
+
+    if (this->isMainThread()) {
+        this->initConfigLock();
+        return this->isConfigLockInitialized();
+    }
+
+    // only happens if a mod uses Argon from another thread before we were loaded.
+    // blocking here could deadlock if this is the main thread after all, so the caller has to do without
+    geode::Loader::get()->queueInMainThread([this] {
+        this->initConfigLock();
+    });
+
+    return false;
 }
 
 bool ArgonState::isConfigLockInitialized() {
-    return m_configLock.load(acquire) != nullptr;
+    return m_configRwLock.load(acquire) != nullptr;
+}
+
+void ArgonState::setMainThread() {
+    m_mainThread.store(std::this_thread::get_id(), release);
+}
+
+bool ArgonState::isMainThread() const {
+    if (!this->isMainThreadKnown()) {
+        // try to be safe and not always return false
+        return geode::utils::thread::getName() == "Main";
+    }
+
+    return std::this_thread::get_id() == m_mainThread.load(acquire);
+}
+
+bool ArgonState::isMainThreadKnown() const {
+    return m_mainThread.load(acquire) != std::thread::id{};
 }
 
 void ArgonState::handleSuccessfulAuth(AccountData account, std::string authToken, std::string serverIdent, int commentId) {
+    // saved right away rather than in the background, so that any call after this one finds the token.
+    // this only updates the cache, the storage is written by its own worker
+    if (auto err = ArgonStorage::get().storeAuthToken(account, this->serverUrl(), serverIdent, authToken).err()) {
+        log::warn("(Argon) failed to save authtoken: {}", *err);
+    }
+
+    if (commentId == 0) {
+        return;
+    }
+
     arc::spawn([
         account = std::move(account),
-        authToken = std::move(authToken),
-        serverIdent = std::move(serverIdent),
         commentId
     ](this auto self) -> arc::Future<> {
-        // save authtoken
-        if (auto err = ArgonStorage::get().storeAuthToken(account, serverIdent, authToken).err()) {
-            log::warn("(Argon) failed to save authtoken: {}", *err);
-        }
-
         // don't care if the message deletion fails
-        if (commentId != 0) {
-            (void) co_await web::deleteGDMessage(account, commentId);
-        }
+        (void) co_await web::deleteGDMessage(account, commentId);
     });
 }
 
@@ -1,34 +1,112 @@
 #pragma once
 #include <argon/argon.hpp>
 #include "util.hpp"
+#include "AuthScheduler.hpp"
+#include "LockStats.hpp"
+#include "SharedAuthRegistry.hpp"
+#include "StorageGeneration.hpp"
 
-#include <asp/sync/Mutex.hpp>
 #include <asp/time/SystemTime.hpp>
 #include <atomic>
+#include <thread>
 
 namespace argon {
 
+// Exclusive access to the token storage. Besides the reader-writer lock this also holds the legacy mutex,
+// which is the only lock that older Argon versions know about, unless only the in-memory cache is being changed.
+// The locks are always taken in that order
+struct ConfigWriteLock {
+    // declared first so that it's destroyed last, statistics are recorded once the lock is released
+    LockHoldTimer timer;
+    std::unique_lock<std::shared_mutex> rw;
+    std::unique_lock<std::mutex> legacy;
+
+    // runs before the members are destroyed, so the hold ends before unlocking
+    ~ConfigWriteLock() {
+        timer.stop();
+    }
+};
+
+struct ConfigReadLock {
+    LockHoldTimer timer;
+    std::shared_lock<std::shared_mutex> rw;
+
+    ~ConfigReadLock() {
+        timer.stop();
+    }
+};
+
+// Immutable snapshot of the server configuration, replaced as a whole whenever it changes
+struct ServerConfig {
+    // without trailing slashes
+    std::string url;
+
+    // full urls of every endpoint, built once so that requests don't have to format them
+    std::string challengeStartUrl;
+    std::string challengeVerifyUrl;
+    std::string challengeVerifyPollUrl;
+};
+
 class ArgonState : public SingletonBase<ArgonState> {
 public:
     void setServerUrl(std::string url);
     std::string getServerUrl() const;
-    std::string makeUrl(std::string_view suffix) const;
+    // Same as `getServerUrl`, without the copy. The view stays valid until exit, even after the url is changed
+    std::string_view serverUrl() const;
+    // The current configuration, lock-free. Stays valid until exit, even after the configuration is changed
+    const ServerConfig& serverConfig() const;
 
     void setCertVerification(bool state);
     bool getCertVerification() const;
 
-    std::lock_guard<std::mutex> acquireConfigLock();
+    // `site` only matters for lock statistics
+    ConfigWriteLock acquireConfigLock(LockSite site);
+    ConfigReadLock acquireConfigReadLock(LockSite site);
+    // Exclusive access without the legacy mutex, for changes that don't touch the files
+    ConfigWriteLock acquireCacheLock(LockSite site);
+    // Looks up the locks shared by all Argon copies, or publishes new ones. Must run on the main thread,
+    // as GameManager user objects are not thread-safe. Does nothing after the first call
     void initConfigLock();
+    // Initializes the config lock right away on the main thread, other threads only queue that and never wait for it.
+    // Returns whether the config lock is initialized
+    bool ensureConfigLock();
     bool isConfigLockInitialized();
 
+    // Everything below needs the config lock to be initialized
+
+    // Statistics of the config lock, shared by all Argon copies
+    SharedLockStatsV1& lockStats();
+    // Authentication attempts running in any Argon copy
+    SharedAuthRegistryV1& authRegistry();
+    // Limits how many authentication attempts run at once, across all Argon copies
+    SharedAuthSchedulerV1& authScheduler();
+    // Bumped whenever any Argon copy writes the token storage
+    SharedStorageGenerationV1& storageGeneration();
+
+    // Marks the calling thread as the one that runs the game loop
+    void setMainThread();
+    // Falls back to checking the thread name if `setMainThread` was never called
+    bool isMainThread() const;
+    bool isMainThreadKnown() const;
+
     void handleSuccessfulAuth(AccountData account, std::string authToken, std::string serverIdent, int commentId);
 
 protected:
     friend class SingletonBase;
 
-    asp::Mutex<std::string> m_serverUrl;
+    // old snapshots are kept until exit, as readers could still be using one.
+    // a new one is only made when the url actually changes, which is rarely more than once
+    Published<ServerConfig> m_serverConfig;
     std::atomic<bool> m_certVerification{true};
     std::atomic<std::mutex*> m_configLock = nullptr;
+    std::atomic<std::shared_mutex*> m_configRwLock = nullptr;
+    std::atomic<SharedLockStatsV1*> m_lockStats = nullptr;
+    std::atomic<SharedAuthRegistryV1*> m_authRegistry = nullptr;
+    std::atomic<SharedAuthSchedulerV1*> m_authScheduler = nullptr;
+    std::atomic<SharedStorageGenerationV1*> m_storageGeneration = nullptr;
+    std::atomic<bool> m_configLockBootstrapping = false;
+    // default constructed until known
+    std::atomic<std::thread::id> m_mainThread;
 
     ArgonState();
 };
@@ -1,199 +1,356 @@
 #include "ArgonStorage.hpp"
 #include "ArgonState.hpp"
+#include "LockStats.hpp"
+#include "MemoryTokenBackend.hpp"
 
+#include <Geode/binding/GameManager.hpp>
 #include <Geode/loader/Dirs.hpp>
-#include <Geode/utils/file.hpp>
-#include <matjson.hpp>
-#include <asp/fs.hpp>
+#include <Geode/loader/Loader.hpp>
+#include <Geode/loader/Mod.hpp>
+#include <thread>
 
 using namespace geode::prelude;
+using enum std::memory_order;
 
-static auto storagePath = geode::dirs::getModsSaveDir() / ".dankmeme.argon-data.json";
+#ifdef ARGON_BINARY_STORE
+static constexpr bool USE_BINARY_STORE = true;
+#else
+static constexpr bool USE_BINARY_STORE = false;
+#endif
 
 namespace argon {
 
-ArgonStorage::ArgonStorage() {}
+static std::filesystem::path storagePath() {
+    return geode::dirs::getModsSaveDir() / ".dankmeme.argon-data.json";
+}
 
-static matjson::Value makeNewConfigFile() {
-    return matjson::makeObject({
-        {"_ver", 0},
-        {"tokens", matjson::Value::array()},
-    });
+ArgonStorage::ArgonStorage()
+    : m_fileBackend(new FileTokenBackend(storagePath(), USE_BINARY_STORE)),
+      m_sharedBackend(m_fileBackend),
+      m_backend(m_fileBackend) {}
+
+ArgonStorage::~ArgonStorage() {
+    // a thread that is still joinable would terminate the game on exit
+    this->joinPrewarm();
 }
 
-static Result<matjson::Value> parseConfigFile(const std::string& data) {
-    matjson::Value out;
+// Publishes a backend of this copy to other Argon copies
+class LocalTokenCache : public SharedTokenCacheV1 {
+public:
+    static LocalTokenCache* create(TokenBackend* backend) {
+        auto ret = new LocalTokenCache(backend);
+        ret->autorelease();
+        return ret;
+    }
+
+    bool getToken(AbiString modId, AbiString url, int accountId, int userId, AbiString username, void* out, AbiStringSink sink) override {
+        LockCallerScope caller(modId);
+        auto token = m_backend->get({url, accountId, userId}, username);
+        if (!token) {
+            return false;
+        }
 
-    auto res = matjson::parse(data);
-    if (!res) {
-        return Err("parse error: {}", res.unwrapErr());
+        sink(out, *token);
+        return true;
     }
 
-    out = std::move(res).unwrap();
+    bool storeToken(AbiString modId, AbiString url, int accountId, int userId, AbiString username, AbiString ident, AbiString token, void* err, AbiStringSink errSink) override {
+        LockCallerScope caller(modId);
+        auto res = m_backend->upsert({url, accountId, userId}, username, ident, token);
+        if (!res) {
+            errSink(err, res.unwrapErr());
+            return false;
+        }
 
-    // validation
-    if (
-        !out["_ver"].isNumber()
-        || !out["tokens"].isArray()
-    ) {
-        return Err("invalid structure");
+        return true;
     }
 
-    return Ok(std::move(out));
-}
+    void clearTokens(AbiString modId, AbiString url, const int* accountIds, size_t count) override {
+        LockCallerScope caller(modId);
+        m_backend->eraseAccounts(url, std::span{accountIds, count});
+    }
 
-static matjson::Value loadOrCreateConfig() {
-    matjson::Value data;
+    void clearAllTokens(AbiString modId, AbiString url) override {
+        LockCallerScope caller(modId);
+        m_backend->eraseServer(url);
+    }
 
-    if (asp::fs::isFile(storagePath)) {
-        auto res = geode::utils::file::readString(storagePath);
-        if (!res) {
-            log::warn("(Argon) failed to read argon data file: {}", res.unwrapErr());
-            data = makeNewConfigFile();
-        } else {
-            auto res2 = parseConfigFile(res.unwrap());
-            if (!res2) {
-                log::warn("(Argon) failed to read config file, resetting: {}", res2.unwrapErr());
-                data = makeNewConfigFile();
-            } else {
-                data = std::move(res2).unwrap();
+    void flush(AbiString modId) override {
+        LockCallerScope caller(modId);
+        m_backend->flush();
+    }
+
+    void getMetrics(AbiString modId, StorageMetrics* out) override {
+        LockCallerScope caller(modId);
+        *out = m_backend->metrics();
+    }
+
+    uint64_t generation(AbiString modId) override {
+        LockCallerScope caller(modId);
+        return m_backend->generation();
+    }
+
+    void requestMaxTokens(AbiString modId, size_t count) override {
+        m_backend->requestMaxTokens(count);
+    }
+
+    void getTokens(AbiString modId, const AbiTokenQuery* queries, size_t count, void* out, AbiIndexedStringSink sink) override {
+        LockCallerScope caller(modId);
+        std::vector<TokenQuery> local;
+        local.reserve(count);
+
+        for (size_t i = 0; i < count; i++) {
+            auto& q = queries[i];
+            local.push_back({{q.url, q.accountId, q.userId}, q.username});
+        }
+
+        auto tokens = m_backend->getMany(local);
+
+        for (size_t i = 0; i < count; i++) {
+            if (tokens[i]) {
+                sink(out, i, *tokens[i]);
             }
         }
-    } else {
-        data = makeNewConfigFile();
     }
 
-    data["_ver"] = data["_ver"].asUInt().unwrapOr(0) + 1;
+private:
+    TokenBackend* m_backend;
 
-    return data;
-}
+    LocalTokenCache(TokenBackend* backend) : m_backend(backend) {}
+};
 
-Result<> ArgonStorage::storeAuthToken(const AccountData& account, std::string_view serverIdent, std::string_view authtoken) {
-    auto _lock = ArgonState::get().acquireConfigLock();
+// Backend that forwards everything to the shared cache of another Argon copy
+class RemoteTokenBackend : public TokenBackend {
+public:
+    RemoteTokenBackend(SharedTokenCacheV1* cache) : m_cache(cache) {
+        // keep it alive for as long as we use it
+        m_cache->retain();
+    }
 
-    auto data = loadOrCreateConfig();
+    std::optional<std::string> get(TokenKeyView key, std::string_view username) override {
+        std::string token;
+        if (!m_cache->getToken(m_modId, key.url, key.accountId, key.userId, username, &token, &writeToStdString)) {
+            return std::nullopt;
+        }
 
-    // find if theres any token that has the same data, replace it instead of adding a new entry
-    bool insertedToken = false;
+        return token;
+    }
 
-    // parseConfigFile already verified for us that data["tokens"] will be valid
-    auto& arr = data["tokens"].asArray().unwrap();
+    std::vector<std::optional<std::string>> getMany(std::span<const TokenQuery> queries) override {
+        std::vector<AbiTokenQuery> abiQueries;
+        abiQueries.reserve(queries.size());
 
-    auto serverUrl = ArgonState::get().getServerUrl();
+        for (auto& q : queries) {
+            abiQueries.push_back({q.key.url, q.key.accountId, q.key.userId, q.username});
+        }
 
-    for (auto& value : arr) {
-        std::string url = value["url"].asString().unwrapOrDefault();
-        int accountId = value["accid"].asInt().unwrapOrDefault();
-        int userId = value["userid"].asInt().unwrapOrDefault();
+        std::vector<std::optional<std::string>> out(queries.size());
+        m_cache->getTokens(m_modId, abiQueries.data(), abiQueries.size(), &out, &writeToOptionalStringVec);
 
-        if (url != serverUrl
-            || accountId != account.accountId
-            || userId != account.userId
-        ) {
-            continue;
+        return out;
+    }
+
+    Result<> upsert(TokenKeyView key, std::string_view username, std::string_view serverIdent, std::string_view authtoken) override {
+        std::string err;
+        if (!m_cache->storeToken(m_modId, key.url, key.accountId, key.userId, username, serverIdent, authtoken, &err, &writeToStdString)) {
+            return Err(std::move(err));
         }
 
-        // if the same url and account ID, this leaves ident, username and the token fields to be arbitrary
-        // and indeed, we will ignore their current values and just replace them
-        value["name"] = account.username;
-        value["ident"] = serverIdent;
-        value["token"] = authtoken;
+        return Ok();
+    }
 
-        insertedToken = true;
-        break;
+    void eraseAccounts(std::string_view url, std::span<const int> accountIds) override {
+        m_cache->clearTokens(m_modId, url, accountIds.data(), accountIds.size());
     }
 
-    if (!insertedToken) {
-        arr.push_back(matjson::makeObject({
-            {"url", serverUrl},
-            {"accid", account.accountId},
-            {"userid", account.userId},
-            {"name", account.username},
-            {"ident", serverIdent},
-            {"token", authtoken},
-        }));
+    void eraseServer(std::string_view url) override {
+        m_cache->clearAllTokens(m_modId, url);
     }
 
-    auto res = geode::utils::file::writeToJson(storagePath, data);
-    if (!res) {
-        return Err(fmt::format("failed to save argon data file: {}", res.unwrapErr()));
+    uint64_t generation() override {
+        return m_cache->generation(m_modId);
     }
 
-    return Ok();
+    void requestMaxTokens(size_t count) override {
+        m_cache->requestMaxTokens(m_modId, count);
+    }
+
+    void flush() override {
+        m_cache->flush(m_modId);
+    }
+
+    StorageMetrics metrics() override {
+        StorageMetrics out;
+        m_cache->getMetrics(m_modId, &out);
+        return out;
+    }
+
+private:
+    SharedTokenCacheV1* m_cache;
+    std::string m_modId = Mod::get()->getID();
+};
+
+void ArgonStorage::initSharedCache() {
+    std::call_once(m_sharedCacheOnce, [this] {
+        this->publishSharedCache();
+    });
 }
 
-std::optional<std::string> ArgonStorage::getAuthToken(const AccountData& account, std::string_view serverUrl) {
-    auto _lock = ArgonState::get().acquireConfigLock();
+void ArgonStorage::publishSharedCache() {
+    static const std::string CACHE_KEY = "dankmeme.argon/_token_cache_v1_25ea8834";
 
-    auto data = loadOrCreateConfig();
+    auto gm = GameManager::get();
 
-    // parseConfigFile already verified for us that data["tokens"] will be valid
-    auto& arr = data["tokens"].asArray().unwrap();
+    auto cache = geode::cast::typeinfo_cast<SharedTokenCacheV1*>(gm->getUserObject(CACHE_KEY));
+    if (!cache) {
+        // we're the first copy, our file backend becomes the shared one
+        gm->setUserObject(CACHE_KEY, LocalTokenCache::create(m_fileBackend));
+        return;
+    }
 
-    for (auto& value : arr) {
-        int accountId = value["accid"].asInt().unwrapOrDefault();
-        int userId = value["userid"].asInt().unwrapOrDefault();
+    // the shared storage keeps as many tokens as the copy that asks for the most wants
+    auto remote = new RemoteTokenBackend(cache);
+    remote->requestMaxTokens(FileTokenBackend::MAX_STORED_TOKENS);
+    m_sharedBackend.store(remote, release);
+
+    // only replace the backend if it was not changed with `setBackend`
+    TokenBackend* expected = m_fileBackend;
+    m_backend.compare_exchange_strong(expected, remote, acq_rel);
+}
 
-        if (accountId != account.accountId || userId != account.userId) {
-            continue;
+void ArgonStorage::setBackend(StorageBackend kind) {
+    TokenBackend* backend = nullptr;
+
+    switch (kind) {
+        case StorageBackend::File:
+            backend = m_sharedBackend.load(acquire);
+            break;
+        case StorageBackend::Memory: {
+            // every switch starts out empty. the previous ones are kept until exit, see `m_memoryBackends`
+            auto memory = std::make_unique<MemoryTokenBackend>();
+            backend = memory.get();
+
+            std::lock_guard lock(m_memoryBackendsMutex);
+            m_memoryBackends.push_back(std::move(memory));
+            break;
         }
+    }
 
-        std::string url = value["url"].asString().unwrapOrDefault();
+    m_backend.store(backend, release);
+}
 
-        if (url != serverUrl) {
-            continue;
-        }
+TokenBackend* ArgonStorage::backend() {
+    return m_backend.load(acquire);
+}
 
-        std::string username = value["name"].asString().unwrapOrDefault();
+bool ArgonStorage::ready() {
+    return ArgonState::get().ensureConfigLock();
+}
 
-        if (username != account.username) {
-            continue;
-        }
+Result<> ArgonStorage::storeAuthToken(const AccountData& account, std::string_view serverUrl, std::string_view serverIdent, std::string_view authtoken) {
+    // tokens only come from `startAuth`, which waits for the main thread to load Argon
+    if (!this->ready()) {
+        return Err("Argon is not loaded yet");
+    }
 
-        // std::string ident = value["ident"].asString().unwrapOrDefault();
-        std::string token = value["token"].asString().unwrapOrDefault();
+    return this->backend()->upsert({serverUrl, account.accountId, account.userId}, account.username, serverIdent, authtoken);
+}
 
-        return std::make_optional(std::move(token));
+std::optional<std::string> ArgonStorage::getAuthToken(const AccountData& account, std::string_view serverUrl) {
+    if (!this->ready()) {
+        return std::nullopt;
     }
 
-    return std::nullopt;
+    return this->backend()->get({serverUrl, account.accountId, account.userId}, account.username);
 }
 
 bool ArgonStorage::hasAuthToken(const AccountData& account, std::string_view serverUrl) {
     return this->getAuthToken(account, serverUrl).has_value();
 }
 
-void ArgonStorage::clearTokens(int accountId) {
-    auto _lock = ArgonState::get().acquireConfigLock();
+std::vector<std::optional<std::string>> ArgonStorage::getAuthTokens(std::span<const AccountData> accounts, std::string_view serverUrl) {
+    if (!this->ready()) {
+        return std::vector<std::optional<std::string>>(accounts.size());
+    }
 
-    auto data = loadOrCreateConfig();
+    std::vector<TokenQuery> queries;
+    queries.reserve(accounts.size());
 
-    // parseConfigFile already verified for us that data["tokens"] will be valid
-    auto& arr = data["tokens"].asArray().unwrap();
+    for (auto& account : accounts) {
+        queries.push_back({{serverUrl, account.accountId, account.userId}, account.username});
+    }
 
-    for (int i = arr.size() - 1; i >= 0; i--) {
-        auto& val = arr[i];
+    return this->backend()->getMany(queries);
+}
 
-        if (val["accid"].asInt().unwrapOrDefault() == accountId) {
-            arr.erase(arr.begin() + i);
-        }
+void ArgonStorage::clearTokens(int accountId, std::string_view serverUrl) {
+    this->clearTokens(std::span{&accountId, 1}, serverUrl);
+}
+
+void ArgonStorage::clearTokens(std::span<const int> accountIds, std::string_view serverUrl) {
+    if (!this->ready()) {
+        Loader::get()->queueInMainThread([ids = std::vector(accountIds.begin(), accountIds.end()), url = std::string{serverUrl}] {
+            ArgonStorage::get().clearTokens(ids, url);
+        });
+        return;
+    }
+
+    this->backend()->eraseAccounts(serverUrl, accountIds);
+}
+
+void ArgonStorage::clearAllTokens(std::string_view serverUrl) {
+    if (!this->ready()) {
+        Loader::get()->queueInMainThread([url = std::string{serverUrl}] {
+            ArgonStorage::get().clearAllTokens(url);
+        });
+        return;
     }
 
-    auto res = geode::utils::file::writeToJson(storagePath, data);
-    if (!res) {
-        log::warn("(Argon) failed to save argon data file: {}", res.unwrapErr());
+    this->backend()->eraseServer(serverUrl);
+}
+
+void ArgonStorage::flush() {
+    // a prewarm that is still running could queue changes after this, it's done long before the game exits anyway
+    this->joinPrewarm();
+
+    // nothing could have been changed yet
+    if (!this->ready()) {
+        return;
     }
+
+    this->backend()->flush();
 }
 
-void ArgonStorage::clearAllTokens() {
-    auto _lock = ArgonState::get().acquireConfigLock();
+StorageMetrics ArgonStorage::getMetrics() {
+    if (!this->ready()) {
+        return {};
+    }
+
+    return this->backend()->metrics();
+}
+
+void ArgonStorage::prewarm(std::optional<AccountData> account, std::string serverUrl) {
+    std::lock_guard lock(m_prewarmMutex);
+    if (m_prewarmThread.joinable()) {
+        m_prewarmThread.join();
+    }
+
+    m_prewarmThread = std::thread([this, account = std::move(account), serverUrl = std::move(serverUrl)] {
+        auto backend = this->backend();
+        backend->prewarm();
+
+        // also queues the update of the last use time of the token, rather than leaving that to the first auth call
+        if (account) {
+            (void) backend->get({serverUrl, account->accountId, account->userId}, account->username);
+        }
+    });
+}
 
-    auto data = loadOrCreateConfig();
-    data["tokens"] = matjson::Value::array();
+void ArgonStorage::joinPrewarm() {
+    std::lock_guard lock(m_prewarmMutex);
 
-    auto res = geode::utils::file::writeToJson(storagePath, data);
-    if (!res) {
-        log::warn("(Argon) failed to save argon data file: {}", res.unwrapErr());
+    if (m_prewarmThread.joinable()) {
+        m_prewarmThread.join();
     }
 }
 
@@ -1,7 +1,16 @@
 #pragma once
 #include "util.hpp"
+#include "FileTokenBackend.hpp"
+#include "SharedTokenCache.hpp"
+#include "TokenBackend.hpp"
 #include <argon/argon.hpp>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+
 namespace argon {
 
 class ArgonStorage : public SingletonBase<ArgonStorage> {
@@ -9,14 +18,59 @@ class ArgonStorage : public SingletonBase<ArgonStorage> {
     ArgonStorage();
 
 public:
-    geode::Result<> storeAuthToken(const AccountData& account, std::string_view serverIdent, std::string_view authtoken);
+    ~ArgonStorage();
+
+    geode::Result<> storeAuthToken(const AccountData& account, std::string_view serverUrl, std::string_view serverIdent, std::string_view authtoken);
     std::optional<std::string> getAuthToken(const AccountData& account, std::string_view serverUrl);
     bool hasAuthToken(const AccountData& account, std::string_view serverUrl);
+    std::vector<std::optional<std::string>> getAuthTokens(std::span<const AccountData> accounts, std::string_view serverUrl);
+
+    void clearTokens(int accountId, std::string_view serverUrl);
+    void clearTokens(std::span<const int> accountIds, std::string_view serverUrl);
+    void clearAllTokens(std::string_view serverUrl);
+
+    // Until Argon is loaded (see `ArgonState::ensureConfigLock`), calls from threads other than the main one find no tokens,
+    // and their clears are applied on the main thread.
+
+    // Blocks until all pending changes are written to disk. Changes are otherwise written shortly after they're made
+    // by a background worker, so that callers never wait for disk writes.
+    void flush();
 
-    void clearTokens(int accountId);
-    void clearAllTokens();
+    StorageMetrics getMetrics();
+
+    // Loads the storage and looks up the token of `account` on a background thread,
+    // so that the first auth call doesn't have to wait for the disk. The thread is joined by `flush`
+    void prewarm(std::optional<AccountData> account, std::string serverUrl);
+
+    // Finds the token cache of another Argon copy, or publishes our own. Only does anything the first time it's called,
+    // which has to be on the main thread. Called by `ArgonState::initConfigLock`
+    void initSharedCache();
+
+    // Switches the backend that all calls go to, `StorageBackend::File` switches back to the shared storage
+    void setBackend(StorageBackend kind);
 
 private:
+    // the storage in the mods save directory, used directly until the shared cache is initialized,
+    // and afterwards through the shared cache if it is the one published by this copy
+    FileTokenBackend* m_fileBackend;
+    // `m_fileBackend` or the shared cache of another Argon copy
+    std::atomic<TokenBackend*> m_sharedBackend;
+    // backend that all calls are forwarded to, either `m_sharedBackend` or one selected with `setBackend`.
+    // backends are only freed at exit, as other threads could still be using one after it was replaced
+    std::atomic<TokenBackend*> m_backend;
+    // every backend made for `StorageBackend::Memory`, switching is meant for tests so there are only ever a few
+    std::mutex m_memoryBackendsMutex;
+    std::vector<std::unique_ptr<TokenBackend>> m_memoryBackends;
+    std::once_flag m_sharedCacheOnce;
+    std::mutex m_prewarmMutex;
+    std::thread m_prewarmThread;
+
+    TokenBackend* backend();
+    // Whether the storage can be used right now. Before Argon is loaded, only the main thread can use it,
+    // other threads never wait for it and get no tokens, their clears are done on the main thread
+    bool ready();
+    void publishSharedCache();
+    void joinPrewarm();
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,178 @@
+#include "AuthFlight.hpp"
+
+#include <algorithm>
+#include <functional>
+
+using enum std::memory_order;
+
+namespace argon {
+
+size_t AuthKeyHash::operator()(const AuthKey& key) const {
+    size_t h = std::hash<std::string>{}(key.serverUrl);
+    h ^= std::hash<int>{}(key.accountId) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<int>{}(key.userId) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+AuthFlight::Listener::Listener(std::shared_ptr<AuthFlight> flight, AuthProgressCallback* callback, AuthProgressEventCallback* eventCallback, Wakeup* wakeup)
+    : m_flight(std::move(flight)), m_callback(callback), m_eventCallback(eventCallback), m_wakeup(wakeup)
+{
+    std::optional<AuthProgressEvent> progress;
+    {
+        std::lock_guard lock(m_flight->m_mutex);
+        m_flight->m_listeners.push_back(this);
+        progress = m_flight->m_progress;
+
+        if (m_flight->m_finished.load(std::memory_order::relaxed) && m_wakeup) {
+            m_wakeup->wake();
+        }
+    }
+
+    // callers that join late still get to see which stage the attempt is in
+    if (progress) {
+        this->deliver(*progress, true);
+    }
+}
+
+AuthFlight::Listener::~Listener() {
+    std::unique_lock lock(m_flight->m_mutex);
+    std::erase(m_flight->m_listeners, this);
+
+    // a report that started before we were removed could still be calling our callbacks, which go away with us
+    m_flight->m_delivered.wait(lock, [&] {
+        return m_flight->m_delivering == 0;
+    });
+}
+
+void AuthFlight::Listener::deliver(const AuthProgressEvent& event, bool stageChanged) {
+    if (stageChanged && *m_callback) (*m_callback)(event.progress);
+    if (*m_eventCallback) (*m_eventCallback)(event);
+}
+
+void AuthFlight::reportProgress(const AuthProgressEvent& event) {
+    // callbacks run without the lock, so that they can call back into Argon (e.g. start another attempt).
+    // listeners wait for `m_delivering` to drop to 0 before going away
+    std::vector<Listener*> listeners;
+    bool stageChanged;
+    {
+        std::lock_guard lock(m_mutex);
+        stageChanged = !m_progress || m_progress->progress != event.progress;
+        m_progress = event;
+        listeners = m_listeners;
+        m_delivering++;
+    }
+
+    for (auto listener : listeners) {
+        listener->deliver(event, stageChanged);
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_delivering--;
+    }
+
+    m_delivered.notify_all();
+}
+
+void AuthFlight::setTimings(const AuthTimings& timings) {
+    std::lock_guard lock(m_mutex);
+    m_timings = timings;
+}
+
+AuthTimings AuthFlight::timings() const {
+    std::lock_guard lock(m_mutex);
+    return m_timings;
+}
+
+void AuthFlight::finish(std::optional<AuthResult> result) {
+    std::lock_guard lock(m_mutex);
+    m_result = std::move(result);
+    m_finished.store(true, release);
+
+    for (auto listener : m_listeners) {
+        if (listener->m_wakeup) listener->m_wakeup->wake();
+    }
+}
+
+bool AuthFlight::finished() const {
+    return m_finished.load(acquire);
+}
+
+const std::optional<AuthResult>& AuthFlight::result() const {
+    return m_result;
+}
+
+std::shared_ptr<AuthFlight> AuthFlights::join(const AuthKey& key, bool& leader) {
+    std::lock_guard lock(m_mutex);
+
+    auto [it, inserted] = m_flights.try_emplace(key);
+    if (inserted) {
+        it->second = std::make_shared<AuthFlight>();
+    }
+
+    leader = inserted;
+    return it->second;
+}
+
+void AuthFlights::finish(const AuthKey& key, const std::shared_ptr<AuthFlight>& flight, std::optional<AuthResult> result) {
+    // removed first, anyone who comes after this either finds the stored token or starts a new attempt
+    {
+        std::lock_guard lock(m_mutex);
+
+        auto it = m_flights.find(key);
+        if (it != m_flights.end() && it->second == flight) {
+            m_flights.erase(it);
+        }
+    }
+
+    flight->finish(std::move(result));
+}
+
+AuthLeader::AuthLeader(AuthKey key, std::shared_ptr<AuthFlight> flight)
+    : m_key(std::move(key)), m_flight(std::move(flight)) {}
+
+AuthLeader::~AuthLeader() {
+    if (!m_finished) {
+        AuthFlights::get().finish(m_key, m_flight, std::nullopt);
+    }
+}
+
+void AuthLeader::finish(AuthResult result) {
+    m_finished = true;
+    AuthFlights::get().finish(m_key, m_flight, std::move(result));
+}
+
+AuthStageClock::AuthStageClock(AuthFlight& flight)
+    : m_flight(flight), m_stageStart(std::chrono::steady_clock::now()) {}
+
+AuthStageClock::~AuthStageClock() {
+    this->endStage(std::chrono::steady_clock::now());
+    m_flight.setTimings(m_timings);
+}
+
+void AuthStageClock::enter(std::chrono::milliseconds AuthTimings::* stage, AuthProgress progress, std::optional<uint32_t> pollAfterMs) {
+    auto now = std::chrono::steady_clock::now();
+    auto spent = this->endStage(now);
+    m_stage = stage;
+
+    m_flight.reportProgress(AuthProgressEvent {
+        .progress = progress,
+        .timestamp = now,
+        .previousStageTime = spent,
+        .pollCount = m_timings.pollCount,
+        .pollAfterMs = pollAfterMs,
+    });
+}
+
+void AuthStageClock::countPoll() {
+    m_timings.pollCount++;
+}
+
+std::chrono::milliseconds AuthStageClock::endStage(std::chrono::steady_clock::time_point now) {
+    auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_stageStart);
+    m_timings.*m_stage += spent;
+    m_stageStart = now;
+    return spent;
+}
+
+}
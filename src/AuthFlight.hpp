@@ -0,0 +1,140 @@
+#pragma once
+#include "util.hpp"
+#include "Wakeup.hpp"
+
+#include <argon/argon.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace argon {
+
+// What an authentication attempt is for, concurrent attempts with the same key share their result
+struct AuthKey {
+    std::string serverUrl;
+    int accountId;
+    int userId;
+
+    bool operator==(const AuthKey&) const = default;
+};
+
+struct AuthKeyHash {
+    size_t operator()(const AuthKey& key) const;
+};
+
+using AuthResult = geode::Result<std::string>;
+
+// A single authentication attempt, which any number of `startAuth` calls can wait on. Thread-safe.
+class AuthFlight {
+public:
+    // Feeds the progress of the attempt to the callbacks until destroyed, starting with the latest progress if there was any,
+    // and wakes up `wakeup` once the attempt finishes. The callbacks and `wakeup` must outlive the listener.
+    // Callbacks are called without holding any lock, destroying the listener waits for a running callback to return
+    class Listener {
+    public:
+        Listener(std::shared_ptr<AuthFlight> flight, AuthProgressCallback* callback, AuthProgressEventCallback* eventCallback, Wakeup* wakeup);
+        ~Listener();
+
+        Listener(const Listener&) = delete;
+        Listener& operator=(const Listener&) = delete;
+
+    private:
+        friend class AuthFlight;
+
+        std::shared_ptr<AuthFlight> m_flight;
+        AuthProgressCallback* m_callback;
+        AuthProgressEventCallback* m_eventCallback;
+        Wakeup* m_wakeup;
+
+        // the enum callback only hears about stage changes, not every poll round
+        void deliver(const AuthProgressEvent& event, bool stageChanged);
+    };
+
+    void reportProgress(const AuthProgressEvent& event);
+
+    // Stage breakdown of the attempt, set by whoever runs it before finishing
+    void setTimings(const AuthTimings& timings);
+    AuthTimings timings() const;
+
+    // Sets the result, `std::nullopt` means that the attempt was abandoned and waiters should start their own
+    void finish(std::optional<AuthResult> result);
+    bool finished() const;
+    // Only valid once finished
+    const std::optional<AuthResult>& result() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<Listener*> m_listeners;
+    // how many `reportProgress` calls are running callbacks, signaled whenever one is done
+    size_t m_delivering = 0;
+    std::condition_variable m_delivered;
+    std::optional<AuthProgressEvent> m_progress;
+    std::optional<AuthResult> m_result;
+    AuthTimings m_timings;
+    std::atomic<bool> m_finished = false;
+};
+
+// Authentication attempts that are currently running, so that concurrent `startAuth` calls for the same account
+// don't each go through the whole challenge
+class AuthFlights : public SingletonBase<AuthFlights> {
+public:
+    // Returns the running attempt for this key, or starts tracking a new one.
+    // `leader` is set if the attempt is new, the caller then has to run it and pass the result to `finish`
+    std::shared_ptr<AuthFlight> join(const AuthKey& key, bool& leader);
+    void finish(const AuthKey& key, const std::shared_ptr<AuthFlight>& flight, std::optional<AuthResult> result);
+
+private:
+    friend class SingletonBase;
+    AuthFlights() = default;
+
+    std::mutex m_mutex;
+    std::unordered_map<AuthKey, std::shared_ptr<AuthFlight>, AuthKeyHash> m_flights;
+};
+
+// Held by the call that runs an attempt, abandons the attempt if destroyed without finishing it (e.g. the future was dropped)
+class AuthLeader {
+public:
+    AuthLeader(AuthKey key, std::shared_ptr<AuthFlight> flight);
+    ~AuthLeader();
+
+    AuthLeader(const AuthLeader&) = delete;
+    AuthLeader& operator=(const AuthLeader&) = delete;
+
+    void finish(AuthResult result);
+
+private:
+    AuthKey m_key;
+    std::shared_ptr<AuthFlight> m_flight;
+    bool m_finished = false;
+};
+
+// Measures the stages of an attempt run by this call and reports them through its flight.
+// The stage that is running when this is destroyed is counted too, so failed attempts get a breakdown as well
+class AuthStageClock {
+public:
+    explicit AuthStageClock(AuthFlight& flight);
+    ~AuthStageClock();
+
+    AuthStageClock(const AuthStageClock&) = delete;
+    AuthStageClock& operator=(const AuthStageClock&) = delete;
+
+    // Ends the current stage and starts `stage`, reporting `progress`. Entering the stage that is already running starts a new round of it
+    void enter(std::chrono::milliseconds AuthTimings::* stage, AuthProgress progress, std::optional<uint32_t> pollAfterMs = std::nullopt);
+    void countPoll();
+
+private:
+    AuthFlight& m_flight;
+    AuthTimings m_timings;
+    std::chrono::milliseconds AuthTimings::* m_stage = &AuthTimings::queued;
+    std::chrono::steady_clock::time_point m_stageStart;
+
+    std::chrono::milliseconds endStage(std::chrono::steady_clock::time_point now);
+};
+
+}
@@ -0,0 +1,102 @@
+#include "AuthScheduler.hpp"
+
+#include <algorithm>
+
+namespace argon {
+
+AuthScheduler* AuthScheduler::create() {
+    auto ret = new AuthScheduler();
+    ret->autorelease();
+    return ret;
+}
+
+uint64_t AuthScheduler::enqueue(AbiString url, int accountId, int32_t priority, AbiWaker waker) {
+    std::lock_guard lock(m_mutex);
+
+    uint64_t id = m_nextId++;
+    m_requests.push_back(Request {
+        .id = id,
+        .url = std::string{url},
+        .accountId = accountId,
+        .priority = priority,
+        .queuedAt = std::chrono::steady_clock::now(),
+        .waker = waker,
+    });
+
+    this->dispatch();
+    return id;
+}
+
+bool AuthScheduler::poll(uint64_t request) {
+    std::lock_guard lock(m_mutex);
+
+    auto it = std::ranges::find(m_requests, request, &Request::id);
+    return it != m_requests.end() && it->granted;
+}
+
+void AuthScheduler::release(uint64_t request) {
+    std::lock_guard lock(m_mutex);
+
+    std::erase_if(m_requests, [&](const Request& req) {
+        return req.id == request;
+    });
+
+    this->dispatch();
+}
+
+void AuthScheduler::dispatch() {
+    auto now = std::chrono::steady_clock::now();
+
+    auto effectivePriority = [&](const Request& req) {
+        return req.priority + static_cast<int64_t>((now - req.queuedAt) / AGING_INTERVAL);
+    };
+
+    std::vector<Request*> waiting;
+    for (auto& req : m_requests) {
+        if (!req.granted) waiting.push_back(&req);
+    }
+
+    if (waiting.empty()) return;
+
+    std::ranges::sort(waiting, [&](const Request* a, const Request* b) {
+        auto pa = effectivePriority(*a), pb = effectivePriority(*b);
+        return pa != pb ? pa > pb : a->id < b->id;
+    });
+
+    for (auto req : waiting) {
+        size_t serverRunning = 0, accountRunning = 0;
+
+        for (auto& other : m_requests) {
+            if (!other.granted) continue;
+            serverRunning += other.url == req->url;
+            accountRunning += other.accountId == req->accountId;
+        }
+
+        // a request that has to wait doesn't hold up others that can run, e.g. for a different account
+        if (serverRunning < MAX_PER_SERVER && accountRunning < MAX_PER_ACCOUNT) {
+            req->granted = true;
+            // under the lock, so that the request can't be released and its waiter gone in the meantime
+            req->waker();
+        }
+    }
+}
+
+AuthSlot::AuthSlot(SharedAuthSchedulerV1* scheduler, std::string_view url, int accountId, int32_t priority, AbiWaker waker)
+    : m_scheduler(scheduler), m_request(scheduler->enqueue(url, accountId, priority, waker)) {}
+
+AuthSlot::~AuthSlot() {
+    this->release();
+}
+
+bool AuthSlot::acquired() {
+    return !m_released && m_scheduler->poll(m_request);
+}
+
+void AuthSlot::release() {
+    if (m_released) return;
+
+    m_released = true;
+    m_scheduler->release(m_request);
+}
+
+}
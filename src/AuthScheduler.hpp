@@ -0,0 +1,83 @@
+#pragma once
+#include "SharedTokenCache.hpp"
+
+#include <cocos2d.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace argon {
+
+// Decides which authentication attempts may run their challenge, for every Argon copy in the process.
+// Published through a GameManager user object like the config lock, the same ABI rules as for `SharedTokenCacheV1` apply.
+//
+// A slot is only needed while requesting and solving a challenge, which is what sends GD messages.
+// Attempts give it up once they're just polling for verification, so that the next attempt can start in the meantime.
+class SharedAuthSchedulerV1 : public cocos2d::CCObject {
+public:
+    // Queues a request for a slot, `priority` is an `AuthPriority`. Returns the ID of the request.
+    // `waker` is called under the scheduler lock once the request is given a slot, and never after it's released
+    virtual uint64_t enqueue(AbiString url, int accountId, int32_t priority, AbiWaker waker) = 0;
+    // Returns true once the request was given a slot, it then holds it until released
+    virtual bool poll(uint64_t request) = 0;
+    // Releases the slot, or drops the request if it didn't get one yet
+    virtual void release(uint64_t request) = 0;
+};
+
+class AuthScheduler : public SharedAuthSchedulerV1 {
+public:
+    // Challenges that may run at once against a single Argon server / for a single GD account
+    static constexpr size_t MAX_PER_SERVER = 4;
+    static constexpr size_t MAX_PER_ACCOUNT = 1;
+    // Waiting requests gain one priority level for every this long they wait, so that background attempts can't starve
+    static constexpr std::chrono::seconds AGING_INTERVAL{10};
+
+    static AuthScheduler* create();
+
+    uint64_t enqueue(AbiString url, int accountId, int32_t priority, AbiWaker waker) override;
+    bool poll(uint64_t request) override;
+    void release(uint64_t request) override;
+
+private:
+    struct Request {
+        uint64_t id;
+        std::string url;
+        int accountId;
+        int32_t priority;
+        std::chrono::steady_clock::time_point queuedAt;
+        AbiWaker waker;
+        bool granted = false;
+    };
+
+    std::mutex m_mutex;
+    uint64_t m_nextId = 1;
+    std::vector<Request> m_requests;
+
+    AuthScheduler() = default;
+
+    // Hands out free slots to waiting requests, highest priority first, then oldest first, and wakes them up.
+    // Slots only free up on release, so dispatching then (and on enqueue) is enough for aging to take effect
+    void dispatch();
+};
+
+// A request for a slot, released when destroyed. `waker` is called once the slot is acquired
+class AuthSlot {
+public:
+    AuthSlot(SharedAuthSchedulerV1* scheduler, std::string_view url, int accountId, int32_t priority, AbiWaker waker);
+    ~AuthSlot();
+
+    AuthSlot(const AuthSlot&) = delete;
+    AuthSlot& operator=(const AuthSlot&) = delete;
+
+    bool acquired();
+    void release();
+
+private:
+    SharedAuthSchedulerV1* m_scheduler;
+    uint64_t m_request;
+    bool m_released = false;
+};
+
+}
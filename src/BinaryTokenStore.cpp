@@ -0,0 +1,251 @@
+#include "BinaryTokenStore.hpp"
+#include "FileIO.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <unordered_map>
+
+using geode::Ok;
+using geode::Err;
+
+namespace argon {
+
+static_assert(std::endian::native == std::endian::little, "binary token store assumes a little endian platform");
+
+namespace {
+
+struct BinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t generation;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint32_t recordCount;
+    uint32_t recordsOffset;
+    uint32_t stringsOffset;
+    uint32_t stringsSize;
+};
+
+struct BinaryRecord {
+    int32_t accountId;
+    int32_t userId;
+    uint32_t url;
+    uint32_t name;
+    uint32_t ident;
+    uint32_t token;
+    int64_t createdAt;
+    int64_t lastUsedAt;
+};
+
+static_assert(sizeof(BinaryHeader) == 48);
+static_assert(sizeof(BinaryRecord) == 40);
+
+}
+
+static constexpr char BINARY_MAGIC[4] = {'A', 'R', 'G', 'B'};
+
+template <typename T>
+static T readAt(std::span<const uint8_t> data, size_t offset) {
+    // the mapping is not necessarily aligned for T
+    T out;
+    std::memcpy(&out, data.data() + offset, sizeof(T));
+    return out;
+}
+
+geode::Result<BinaryTokenStore> BinaryTokenStore::open(const std::filesystem::path& path) {
+    GEODE_UNWRAP_INTO(auto file, MappedFile::open(path));
+
+    std::span<const uint8_t> data{file.data(), file.size()};
+    if (data.size() < sizeof(BinaryHeader)) {
+        return Err("file too small");
+    }
+
+    auto header = readAt<BinaryHeader>(data, 0);
+    if (std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        return Err("invalid header");
+    }
+
+    if (header.version != VERSION) {
+        return Err("unsupported version {}", header.version);
+    }
+
+    uint64_t recordsEnd = header.recordsOffset + uint64_t(header.recordCount) * sizeof(BinaryRecord);
+    uint64_t stringsEnd = uint64_t(header.stringsOffset) + header.stringsSize;
+
+    if (recordsEnd > data.size() || stringsEnd > data.size()) {
+        return Err("file is truncated");
+    }
+
+    BinaryTokenStore out;
+    out.m_generation = header.generation;
+    out.m_sourceSize = header.sourceSize;
+    out.m_sourceMtime = header.sourceMtime;
+    out.m_records = data.subspan(header.recordsOffset, header.recordCount * sizeof(BinaryRecord));
+    out.m_strings = data.subspan(header.stringsOffset, header.stringsSize);
+    out.m_file = std::move(file);
+
+    return Ok(std::move(out));
+}
+
+std::vector<uint8_t> BinaryTokenStore::encode(std::span<const TokenView> tokens, uint64_t generation) {
+    std::vector<TokenView> sorted{tokens.begin(), tokens.end()};
+    std::sort(sorted.begin(), sorted.end(), [](const TokenView& a, const TokenView& b) {
+        return std::tie(a.accountId, a.userId) < std::tie(b.accountId, b.userId);
+    });
+
+    std::vector<uint8_t> strings;
+    std::unordered_map<std::string_view, uint32_t> interned;
+
+    auto intern = [&](std::string_view str) -> uint32_t {
+        auto [it, inserted] = interned.try_emplace(str, static_cast<uint32_t>(strings.size()));
+        if (inserted) {
+            uint32_t len = static_cast<uint32_t>(str.size());
+            auto lenBytes = reinterpret_cast<const uint8_t*>(&len);
+            strings.insert(strings.end(), lenBytes, lenBytes + sizeof(len));
+            strings.insert(strings.end(), str.begin(), str.end());
+        }
+
+        return it->second;
+    };
+
+    std::vector<BinaryRecord> records;
+    records.reserve(sorted.size());
+
+    for (auto& token : sorted) {
+        records.push_back(BinaryRecord {
+            .accountId = token.accountId,
+            .userId = token.userId,
+            .url = intern(token.url),
+            .name = intern(token.name),
+            .ident = intern(token.ident),
+            .token = intern(token.token),
+            .createdAt = token.createdAt,
+            .lastUsedAt = token.lastUsedAt,
+        });
+    }
+
+    BinaryHeader header{};
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = VERSION;
+    header.generation = generation;
+    header.recordCount = static_cast<uint32_t>(records.size());
+    header.recordsOffset = sizeof(BinaryHeader);
+    header.stringsOffset = static_cast<uint32_t>(header.recordsOffset + records.size() * sizeof(BinaryRecord));
+    header.stringsSize = static_cast<uint32_t>(strings.size());
+
+    std::vector<uint8_t> out(header.stringsOffset + strings.size());
+    std::memcpy(out.data(), &header, sizeof(header));
+    if (!records.empty()) {
+        std::memcpy(out.data() + header.recordsOffset, records.data(), records.size() * sizeof(BinaryRecord));
+    }
+    if (!strings.empty()) {
+        std::memcpy(out.data() + header.stringsOffset, strings.data(), strings.size());
+    }
+
+    return out;
+}
+
+geode::Result<> BinaryTokenStore::write(const std::filesystem::path& path, std::vector<uint8_t> data, uint64_t sourceSize, int64_t sourceMtime) {
+    if (data.size() < sizeof(BinaryHeader)) {
+        return Err("invalid data");
+    }
+
+    std::memcpy(data.data() + offsetof(BinaryHeader, sourceSize), &sourceSize, sizeof(sourceSize));
+    std::memcpy(data.data() + offsetof(BinaryHeader, sourceMtime), &sourceMtime, sizeof(sourceMtime));
+
+    // note: on windows this fails while another mod has the old file mapped,
+    // in which case the stale file gets rebuilt on a later load.
+    // not synced to disk, as the file can always be rebuilt from the JSON snapshot
+    return writeFileAtomic(path, data, false);
+}
+
+uint64_t BinaryTokenStore::generation() const {
+    return m_generation;
+}
+
+bool BinaryTokenStore::builtFrom(uint64_t sourceSize, int64_t sourceMtime) const {
+    return m_sourceSize == sourceSize && m_sourceMtime == sourceMtime;
+}
+
+std::optional<TokenView> BinaryTokenStore::find(TokenKeyView key) const {
+    for (size_t i = this->lowerBound(key.accountId, key.userId); i < this->size(); i++) {
+        auto token = this->tokenAt(i);
+        if (token.accountId != key.accountId || token.userId != key.userId) {
+            break;
+        }
+
+        if (token.url == key.url) {
+            return token;
+        }
+    }
+
+    return std::nullopt;
+}
+
+bool BinaryTokenStore::containsAccount(std::string_view url, int accountId) const {
+    for (size_t i = this->lowerBound(accountId, INT32_MIN); i < this->size(); i++) {
+        auto rec = readAt<BinaryRecord>(m_records, i * sizeof(BinaryRecord));
+        if (rec.accountId != accountId) {
+            break;
+        }
+
+        if (this->stringAt(rec.url) == url) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t BinaryTokenStore::size() const {
+    return m_records.size() / sizeof(BinaryRecord);
+}
+
+TokenView BinaryTokenStore::tokenAt(size_t idx) const {
+    auto rec = readAt<BinaryRecord>(m_records, idx * sizeof(BinaryRecord));
+
+    return TokenView {
+        .url = this->stringAt(rec.url),
+        .accountId = rec.accountId,
+        .userId = rec.userId,
+        .name = this->stringAt(rec.name),
+        .ident = this->stringAt(rec.ident),
+        .token = this->stringAt(rec.token),
+        .createdAt = rec.createdAt,
+        .lastUsedAt = rec.lastUsedAt,
+    };
+}
+
+std::string_view BinaryTokenStore::stringAt(uint32_t offset) const {
+    // treat out of bounds strings as empty rather than reading past the mapping
+    if (m_strings.size() < sizeof(uint32_t) || offset > m_strings.size() - sizeof(uint32_t)) {
+        return {};
+    }
+
+    auto len = readAt<uint32_t>(m_strings, offset);
+    if (len > m_strings.size() - offset - sizeof(uint32_t)) {
+        return {};
+    }
+
+    return { reinterpret_cast<const char*>(m_strings.data() + offset + sizeof(uint32_t)), len };
+}
+
+size_t BinaryTokenStore::lowerBound(int accountId, int userId) const {
+    size_t lo = 0, hi = this->size();
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        auto rec = readAt<BinaryRecord>(m_records, mid * sizeof(BinaryRecord));
+
+        if (std::tie(rec.accountId, rec.userId) < std::tie(accountId, userId)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "MappedFile.hpp"
+#include "TokenIndex.hpp"
+
+#include <optional>
+#include <span>
+
+namespace argon {
+
+// Compact binary snapshot of the token storage, opened via mmap so that a lookup only touches the pages it needs.
+//
+// Layout (native little endian):
+// - fixed size header (`BinaryHeader`) with the format version, the storage generation,
+//   and the size + mtime of the JSON snapshot that this file was built from
+// - record table (`BinaryRecord`), sorted by (account ID, user ID)
+// - string section, every string is stored once as a u32 length followed by the bytes,
+//   records refer to strings by their offset into this section
+class BinaryTokenStore {
+public:
+    static constexpr uint32_t VERSION = 2;
+
+    static geode::Result<BinaryTokenStore> open(const std::filesystem::path& path);
+
+    // Serializes the tokens, `generation` is the storage generation they were taken at
+    static std::vector<uint8_t> encode(std::span<const TokenView> tokens, uint64_t generation);
+    // Writes data produced by `encode` to a temporary file and atomically moves it into place,
+    // `sourceSize` and `sourceMtime` describe the JSON file the tokens were taken from
+    static geode::Result<> write(const std::filesystem::path& path, std::vector<uint8_t> data, uint64_t sourceSize, int64_t sourceMtime);
+
+    uint64_t generation() const;
+    bool builtFrom(uint64_t sourceSize, int64_t sourceMtime) const;
+
+    std::optional<TokenView> find(TokenKeyView key) const;
+    bool containsAccount(std::string_view url, int accountId) const;
+    size_t size() const;
+
+    template <typename F>
+    void forEach(F&& func) const {
+        for (size_t i = 0; i < this->size(); i++) {
+            func(this->tokenAt(i));
+        }
+    }
+
+private:
+    MappedFile m_file;
+    uint64_t m_generation = 0;
+    uint64_t m_sourceSize = 0;
+    int64_t m_sourceMtime = 0;
+    std::span<const uint8_t> m_records;
+    std::span<const uint8_t> m_strings;
+
+    TokenView tokenAt(size_t idx) const;
+    std::string_view stringAt(uint32_t offset) const;
+    // index of the first record that is not less than (accountId, userId)
+    size_t lowerBound(int accountId, int userId) const;
+};
+
+}
@@ -0,0 +1,218 @@
+#include "FileIO.hpp"
+
+#include <Geode/platform/cplatform.h>
+#include <algorithm>
+
+#ifdef GEODE_IS_WINDOWS
+# include <Windows.h>
+#else
+# include <cerrno>
+# include <cstring>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+using geode::Ok;
+using geode::Err;
+
+namespace argon {
+
+static std::filesystem::path tempPathFor(const std::filesystem::path& path) {
+    auto out = path;
+    out += ".tmp";
+    return out;
+}
+
+#ifdef GEODE_IS_WINDOWS
+
+static geode::Result<> writeAll(HANDLE file, std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(data.size(), 1 << 30));
+        DWORD written = 0;
+
+        if (!WriteFile(file, data.data(), chunk, &written, nullptr)) {
+            return Err("write failed (error {})", GetLastError());
+        }
+
+        data = data.subspan(written);
+    }
+
+    return Ok();
+}
+
+geode::Result<> writeFileAtomic(const std::filesystem::path& path, std::span<const uint8_t> data, bool sync) {
+    auto tmpPath = tempPathFor(path);
+
+    HANDLE file = CreateFileW(tmpPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return Err("failed to create temporary file (error {})", GetLastError());
+    }
+
+    auto res = writeAll(file, data);
+    if (res && sync && !FlushFileBuffers(file)) {
+        res = Err("failed to flush file (error {})", GetLastError());
+    }
+
+    CloseHandle(file);
+
+    if (!res) {
+        DeleteFileW(tmpPath.c_str());
+        return res;
+    }
+
+    DWORD flags = MOVEFILE_REPLACE_EXISTING | (sync ? MOVEFILE_WRITE_THROUGH : 0);
+    if (!MoveFileExW(tmpPath.c_str(), path.c_str(), flags)) {
+        auto err = GetLastError();
+        DeleteFileW(tmpPath.c_str());
+        return Err("failed to replace file (error {})", err);
+    }
+
+    return Ok();
+}
+
+geode::Result<> appendToFile(const std::filesystem::path& path, std::span<const uint8_t> data, bool sync) {
+    HANDLE file = CreateFileW(
+        path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return Err("failed to open file (error {})", GetLastError());
+    }
+
+    auto res = writeAll(file, data);
+    if (res && sync && !FlushFileBuffers(file)) {
+        res = Err("failed to flush file (error {})", GetLastError());
+    }
+
+    CloseHandle(file);
+    return res;
+}
+
+geode::Result<size_t> readFilePrefix(const std::filesystem::path& path, std::span<uint8_t> out) {
+    HANDLE file = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return Err("failed to open file (error {})", GetLastError());
+    }
+
+    size_t total = 0;
+    while (total < out.size()) {
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(out.size() - total, 1 << 30));
+        DWORD read = 0;
+
+        if (!ReadFile(file, out.data() + total, chunk, &read, nullptr)) {
+            auto err = GetLastError();
+            CloseHandle(file);
+            return Err("read failed (error {})", err);
+        }
+
+        if (read == 0) break;
+        total += read;
+    }
+
+    CloseHandle(file);
+    return Ok(total);
+}
+
+#else
+
+static geode::Result<> writeAll(int fd, std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return Err("write failed: {}", std::strerror(errno));
+        }
+
+        data = data.subspan(written);
+    }
+
+    return Ok();
+}
+
+geode::Result<> writeFileAtomic(const std::filesystem::path& path, std::span<const uint8_t> data, bool sync) {
+    auto tmpPath = tempPathFor(path);
+
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return Err("failed to create temporary file: {}", std::strerror(errno));
+    }
+
+    auto res = writeAll(fd, data);
+    if (res && sync && ::fsync(fd) != 0) {
+        res = Err("failed to flush file: {}", std::strerror(errno));
+    }
+
+    ::close(fd);
+
+    if (!res) {
+        ::unlink(tmpPath.c_str());
+        return res;
+    }
+
+    if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        auto err = errno;
+        ::unlink(tmpPath.c_str());
+        return Err("failed to replace file: {}", std::strerror(err));
+    }
+
+    if (sync) {
+        // make the rename itself durable
+        int dirfd = ::open(path.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (dirfd != -1) {
+            ::fsync(dirfd);
+            ::close(dirfd);
+        }
+    }
+
+    return Ok();
+}
+
+geode::Result<> appendToFile(const std::filesystem::path& path, std::span<const uint8_t> data, bool sync) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return Err("failed to open file: {}", std::strerror(errno));
+    }
+
+    auto res = writeAll(fd, data);
+    if (res && sync && ::fsync(fd) != 0) {
+        res = Err("failed to flush file: {}", std::strerror(errno));
+    }
+
+    ::close(fd);
+    return res;
+}
+
+geode::Result<size_t> readFilePrefix(const std::filesystem::path& path, std::span<uint8_t> out) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return Err("failed to open file: {}", std::strerror(errno));
+    }
+
+    size_t total = 0;
+    while (total < out.size()) {
+        ssize_t read = ::read(fd, out.data() + total, out.size() - total);
+
+        if (read < 0) {
+            if (errno == EINTR) continue;
+            auto err = errno;
+            ::close(fd);
+            return Err("read failed: {}", std::strerror(err));
+        }
+
+        if (read == 0) break;
+        total += read;
+    }
+
+    ::close(fd);
+    return Ok(total);
+}
+
+#endif
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Geode/Result.hpp>
+#include <filesystem>
+#include <span>
+#include <stdint.h>
+
+namespace argon {
+
+enum class FsyncPolicy {
+    // leave flushing to the OS, changes survive a game crash but not necessarily a power loss
+    None,
+    // fsync full rewrites of the storage, but not journal appends
+    Snapshots,
+    // fsync every write
+    Always,
+};
+
+// Writes the data to a temporary file next to `path` and renames it over `path`,
+// so that readers (and a crash) only ever see either the old or the new contents.
+geode::Result<> writeFileAtomic(const std::filesystem::path& path, std::span<const uint8_t> data, bool sync);
+
+// Appends the data to the end of the file (creating it if needed) with a single write call.
+geode::Result<> appendToFile(const std::filesystem::path& path, std::span<const uint8_t> data, bool sync);
+
+// Reads up to `out.size()` bytes from the start of the file, returns the amount of bytes read.
+geode::Result<size_t> readFilePrefix(const std::filesystem::path& path, std::span<uint8_t> out);
+
+}
@@ -0,0 +1,990 @@
+#include "FileTokenBackend.hpp"
+#include "ArgonState.hpp"
+#include "TokenFileReader.hpp"
+
+#include <Geode/utils/file.hpp>
+#include <matjson.hpp>
+#include <algorithm>
+#include <chrono>
+
+using namespace geode::prelude;
+
+namespace argon {
+
+static std::filesystem::path withExtension(std::filesystem::path path, std::string_view ext) {
+    return path.replace_extension(ext);
+}
+
+FileTokenBackend::FileTokenBackend(std::filesystem::path path, bool binaryStore)
+    : m_path(path),
+      m_binaryPath(withExtension(path, ".bin")),
+      m_useBinaryStore(binaryStore),
+      m_journal(withExtension(path, ".journal")),
+      m_generationFile(withExtension(path, ".gen")) {}
+
+static StorageStamp statFile(const std::filesystem::path& path) {
+    std::error_code ec;
+
+    StorageStamp stamp;
+    stamp.mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) return {};
+
+    stamp.size = std::filesystem::file_size(path, ec);
+    if (ec) return {};
+
+    stamp.exists = true;
+    return stamp;
+}
+
+static uint64_t stampTag(const StorageStamp& stamp) {
+    if (!stamp.exists) {
+        return 0;
+    }
+
+    auto ticks = static_cast<uint64_t>(stamp.mtime.time_since_epoch().count());
+    return (stamp.size * 0x9e3779b97f4a7c15ull) ^ ticks;
+}
+
+static int64_t steadyTicks() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+static uint64_t diskTag(const StorageStamp& snapshot, const std::optional<GenerationRecord>& record) {
+    // every write by a current Argon version replaces the generation file, older versions only rewrite the snapshot
+    uint64_t tag = stampTag(snapshot);
+    if (record) {
+        tag ^= record->generation * 0xc2b2ae3d27d4eb4full;
+    }
+
+    // never 0, which means that no tag was read yet
+    return tag | 1;
+}
+
+uint64_t FileTokenBackend::readDiskTag() const {
+    return diskTag(statFile(m_path), m_generationFile.read().ok());
+}
+
+uint64_t FileTokenBackend::currentDiskTag() const {
+    auto now = steadyTicks();
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(DISK_CHECK_INTERVAL).count();
+
+    uint64_t tag = m_diskTag.load(std::memory_order::relaxed);
+    if (tag != 0 && now - m_diskCheckedAt.load(std::memory_order::relaxed) < interval) {
+        return tag;
+    }
+
+    // any number of lookups can get here at once, they all read the same files
+    tag = this->readDiskTag();
+    m_diskTag.store(tag, std::memory_order::relaxed);
+    m_diskCheckedAt.store(now, std::memory_order::relaxed);
+    return tag;
+}
+
+void FileTokenBackend::syncDiskTag(uint64_t tag) {
+    m_syncedDiskTag = tag;
+    m_diskTag.store(tag, std::memory_order::relaxed);
+    m_diskCheckedAt.store(steadyTicks(), std::memory_order::relaxed);
+}
+
+bool FileTokenBackend::upToDate() const {
+    if (!m_loaded || ArgonState::get().storageGeneration().load() != m_syncedGeneration) {
+        return false;
+    }
+
+    // writes by other processes and older Argon versions don't bump the shared generation, only the files show them
+    return this->currentDiskTag() == m_syncedDiskTag;
+}
+
+template <typename F>
+auto FileTokenBackend::withFreshCache(F&& func) {
+    {
+        // fast path, any number of readers can be in here at once
+        auto _lock = ArgonState::get().acquireConfigReadLock(LockSite::Get);
+        if (this->upToDate()) {
+            return func();
+        }
+    }
+
+    // disk reads happen under the write lock, this also excludes older Argon versions that write the file in place
+    auto _lock = ArgonState::get().acquireConfigLock(LockSite::Get);
+    this->revalidate();
+    return func();
+}
+
+template <typename F, typename C>
+auto FileTokenBackend::withFreshCache(F&& func, C&& cold) {
+    {
+        auto _lock = ArgonState::get().acquireConfigReadLock(LockSite::Get);
+        if (this->upToDate()) {
+            return func();
+        }
+    }
+
+    auto _lock = ArgonState::get().acquireConfigLock(LockSite::Get);
+    if (this->upToDate()) {
+        return func();
+    }
+
+    // rather than making the caller wait for the whole file to be loaded, answer straight from disk
+    // and let the storage worker load the cache in the background (every flush starts by revalidating).
+    // pending changes only exist in the cache, and the binary store is cheap enough to load right away
+    if (!m_useBinaryStore && m_pending.empty() && m_writing.empty()) {
+        if (auto res = cold()) {
+            this->scheduleFlush();
+            return std::move(res).unwrap();
+        }
+    }
+
+    this->revalidate();
+    return func();
+}
+
+void FileTokenBackend::revalidate() {
+    // unlike `upToDate` this always looks at the files, an older Argon version could have rewritten the snapshot
+    // without anyone noticing yet, and writing on top of that would lose its changes.
+    // nobody else in this process can write while we hold the lock, so whatever the files look like now is what this generation stands for.
+    // the disk tag is read before the files, so that a write by another process in the meantime shows up as a change later
+    uint64_t generation = ArgonState::get().storageGeneration().load();
+    uint64_t diskTag = this->readDiskTag();
+    bool generationChanged = generation != m_syncedGeneration || diskTag != m_syncedDiskTag;
+    m_syncedGeneration = generation;
+    this->syncDiskTag(diskTag);
+
+    // note: this relies on the mtime having a fine enough resolution to catch two writes in quick succession,
+    // which is the case on all filesystems that GD realistically runs on
+    auto stamp = statFile(m_path);
+
+    if (m_loaded && stamp == m_stamp) {
+        auto jstamp = statFile(m_journal.path());
+        if (jstamp == m_journalStamp) {
+            // nothing we can see changed, the filter only has to be tagged with the new generation and disk tag
+            if (generationChanged) {
+                this->rebuildFilter();
+            }
+
+            return;
+        }
+
+        // another mod appended to the journal, only the new records have to be applied.
+        // compaction always rewrites the snapshot, so a journal that was emptied in the meantime is caught above
+        if (m_journalUsable && m_journalOffset != 0 && jstamp.size > m_journalOffset) {
+            m_loadEpoch++;
+            this->replayJournal(m_journalOffset);
+            this->reapplyPending();
+            this->syncGeneration();
+            this->rebuildFilter();
+            return;
+        }
+    }
+
+    m_loadEpoch++;
+    this->reload(stamp);
+    this->reapplyPending();
+    this->syncGeneration();
+    this->rebuildFilter();
+}
+
+void FileTokenBackend::reapplyPending() {
+    // our unwritten changes come after whatever was just loaded from disk, which is also the order they will be written in.
+    // records that are being written could already be on disk, applying them again doesn't change anything
+    for (auto& record : m_writing) {
+        TokenJournal::apply(m_index, record);
+    }
+
+    for (auto& record : m_pending) {
+        TokenJournal::apply(m_index, record);
+    }
+}
+
+void FileTokenBackend::rebuildFilter() {
+    m_filter.beginUpdate();
+    m_filter.clear();
+
+    this->forEachToken([&](const TokenView& token) {
+        m_filter.insert(token.url, token.accountId);
+    });
+
+    m_filter.setTags(m_syncedGeneration, m_syncedDiskTag);
+    m_filter.endUpdate();
+}
+
+bool FileTokenBackend::definitelyMissing(TokenKeyView key) const {
+    // every Argon copy in the process bumps the storage generation when it writes the files, anyone else shows up in the disk tag.
+    // a write that happens after this point either changes the tags or is in the middle of updating the filter
+    return m_filter.definitelyMissing(key.url, key.accountId, ArgonState::get().storageGeneration().load(), this->currentDiskTag());
+}
+
+static int64_t unixNow() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool needsTouch(const TokenView& token, int64_t now) {
+    return now - token.lastUsedAt >= FileTokenBackend::TOUCH_INTERVAL.count();
+}
+
+static int64_t mtimeTicks(const StorageStamp& stamp) {
+    return static_cast<int64_t>(stamp.mtime.time_since_epoch().count());
+}
+
+// Whether the last commit recorded in the generation file was made on top of this snapshot
+static bool snapshotMatches(const GenerationRecord& record, const StorageStamp& stamp) {
+    return record.snapshotSize == stamp.size && record.snapshotMtime == mtimeTicks(stamp);
+}
+
+void FileTokenBackend::reload(StorageStamp stamp) {
+    m_index.reset();
+    m_base.reset();
+    m_generation = 0;
+    m_stamp = stamp;
+    m_loaded = true;
+    m_journalUsable = true;
+
+    if (stamp.exists) {
+        if (m_useBinaryStore) {
+            this->openBinaryStore();
+        }
+
+        if (!m_base) {
+            this->loadJsonSnapshot();
+
+            if (m_useBinaryStore) {
+                this->importIntoBinaryStore();
+            }
+        }
+    }
+
+    m_snapshotGeneration = m_generation;
+
+    auto record = m_generationFile.read().ok();
+
+    // a snapshot without a generation file was written by an older Argon version, e.g. right before upgrading.
+    // those are most likely still around, so they get to see our changes until the window expires
+    if (!record && stamp.exists) {
+        m_legacyWriteAt = unixNow();
+    }
+
+    if ((record && snapshotMatches(*record, stamp)) || !statFile(m_journal.path()).exists) {
+        // apply the changes made since the snapshot was written
+        this->replayJournal(0);
+    } else {
+        this->discardJournal(record);
+    }
+
+    // stale tokens are dropped by the storage worker rather than whoever happened to trigger the load
+    if (this->needsPruning()) {
+        m_snapshotDue = true;
+        this->scheduleFlush();
+    }
+}
+
+void FileTokenBackend::loadJsonSnapshot() {
+    auto res = geode::utils::file::readString(m_path);
+    if (!res) {
+        log::warn("(Argon) failed to read argon data file: {}", res.unwrapErr());
+        return;
+    }
+
+    auto data = std::move(res).unwrap();
+    TokenFileReader reader{data};
+    StoredToken token;
+
+    while (true) {
+        auto next = reader.next(token);
+
+        if (!next) {
+            log::warn("(Argon) failed to read config file, resetting: {}", next.unwrapErr());
+
+            // our writes are atomic, but older Argon versions write in place and could have been interrupted.
+            // keep the broken file around so the tokens can still be recovered by hand
+            auto backupPath = m_path;
+            backupPath += ".bak";
+
+            std::error_code ec;
+            std::filesystem::copy_file(m_path, backupPath, std::filesystem::copy_options::overwrite_existing, ec);
+
+            m_index.reset();
+            m_generation = 0;
+            return;
+        }
+
+        if (!next.unwrap()) break;
+
+        m_index.upsert(std::move(token));
+    }
+
+    m_generation = reader.version();
+}
+
+Result<std::optional<StoredToken>> FileTokenBackend::scanForToken(TokenKeyView key) {
+    auto stamp = statFile(m_path);
+    auto record = m_generationFile.read().ok();
+
+    if (!record || !snapshotMatches(*record, stamp)) {
+        // the journal doesn't belong to this snapshot, it has to be dropped by `reload` first
+        if (statFile(m_journal.path()).exists) {
+            return Err("token journal is out of date");
+        }
+    } else {
+        // the journal is small and may override the snapshot, so it is checked first
+        TokenIndex journal;
+        GEODE_UNWRAP(m_journal.replay(journal, 0));
+
+        if (auto token = journal.find(key)) {
+            return Ok(*token);
+        }
+
+        if (journal.masks(key)) {
+            return Ok(std::nullopt);
+        }
+    }
+
+    if (!stamp.exists) {
+        return Ok(std::nullopt);
+    }
+
+    GEODE_UNWRAP_INTO(auto data, geode::utils::file::readString(m_path));
+    return TokenFileReader::find(data, key);
+}
+
+void FileTokenBackend::openBinaryStore() {
+    auto res = BinaryTokenStore::open(m_binaryPath);
+    if (!res) {
+        return;
+    }
+
+    auto store = std::move(res).unwrap();
+
+    // the JSON file is the source of truth, if it changed (e.g. written by an older Argon version) the binary store is stale
+    if (!store.builtFrom(m_stamp.size, mtimeTicks(m_stamp))) {
+        return;
+    }
+
+    m_generation = store.generation();
+    m_base = std::move(store);
+}
+
+void FileTokenBackend::importIntoBinaryStore() {
+    std::vector<TokenView> tokens;
+    tokens.reserve(m_index.size());
+    m_index.forEach([&](const StoredToken& token) {
+        tokens.push_back(toView(token));
+    });
+
+    auto res = BinaryTokenStore::write(m_binaryPath, BinaryTokenStore::encode(tokens, m_generation), m_stamp.size, mtimeTicks(m_stamp));
+    if (!res) {
+        log::warn("(Argon) failed to write binary token store: {}", res.unwrapErr());
+        return;
+    }
+
+    // switch over to the mapped store, so that the parsed tokens don't have to stay in memory
+    this->openBinaryStore();
+    if (m_base) {
+        m_index.reset();
+    }
+}
+
+std::optional<TokenView> FileTokenBackend::findToken(TokenKeyView key) const {
+    if (auto token = m_index.find(key)) {
+        return toView(*token);
+    }
+
+    if (m_base && !m_index.masks(key)) {
+        return m_base->find(key);
+    }
+
+    return std::nullopt;
+}
+
+template <typename F>
+void FileTokenBackend::forEachToken(F&& func) const {
+    if (m_base) {
+        m_base->forEach([&](const TokenView& token) {
+            // skip entries that were erased or replaced since the binary store was written
+            TokenKeyView key{token.url, token.accountId, token.userId};
+            if (!m_index.masks(key) && !m_index.find(key)) {
+                func(token);
+            }
+        });
+    }
+
+    m_index.forEach([&](const StoredToken& token) {
+        func(toView(token));
+    });
+}
+
+void FileTokenBackend::replayJournal(uint64_t offset) {
+    auto res = m_journal.replay(m_index, offset);
+
+    if (!res) {
+        log::warn("(Argon) ignoring token journal: {}", res.unwrapErr());
+        m_journalUsable = false;
+        m_journalOffset = 0;
+    } else {
+        m_journalOffset = res.unwrap();
+    }
+
+    m_journalStamp = statFile(m_journal.path());
+}
+
+void FileTokenBackend::discardJournal(const std::optional<GenerationRecord>& record) {
+    // the journal holds changes to an older snapshot, replaying them would bring back tokens that were cleared or replaced since.
+    // the tokens that were stored through the journal are the exception: older versions never read it, so they can't have cleared them.
+    // those are carried over unless the new snapshot has a token for the same account
+    log::info("(Argon) token storage was rewritten by an older Argon version, dropping the token journal");
+    m_legacyWriteAt = unixNow();
+
+    std::vector<StoredToken> carried;
+    if (auto res = m_journal.storedTokens()) {
+        for (auto& token : res.unwrap()) {
+            if (!this->findToken({token.url, token.accountId, token.userId})) {
+                carried.push_back(std::move(token));
+            }
+        }
+    } else {
+        log::warn("(Argon) failed to read token journal: {}", res.unwrapErr());
+    }
+
+    if (auto err = m_journal.reset(false).err()) {
+        log::warn("(Argon) failed to reset token journal: {}", *err);
+        m_journalUsable = false;
+    }
+
+    m_journalStamp = statFile(m_journal.path());
+    m_journalOffset = m_journalStamp.size;
+
+    // the generation file now describes this snapshot, so that the next load doesn't drop the records we append
+    m_generation = std::max(m_snapshotGeneration, record ? record->generation : 0) + 1;
+    this->writeGeneration(false);
+
+    // written by the storage worker like any other change, into the snapshot as the older version is around
+    for (auto& token : carried) {
+        m_filter.insert(token.url, token.accountId);
+        this->enqueue(TokenJournal::encodeUpsert(token));
+        m_index.upsert(std::move(token));
+    }
+}
+
+bool FileTokenBackend::legacyWriterActive() const {
+    return m_legacyWriteAt != 0 && unixNow() - m_legacyWriteAt < LEGACY_WRITER_WINDOW.count();
+}
+
+void FileTokenBackend::syncGeneration() {
+    uint64_t generation = m_snapshotGeneration;
+
+    if (auto res = m_generationFile.read()) {
+        auto record = res.unwrap();
+        generation = std::max(generation, record.generation);
+        m_legacyWriteAt = std::max(m_legacyWriteAt, record.legacyWriteAt);
+
+        // the snapshot was replaced without updating the generation file, which only older Argon versions do
+        if (record.snapshotSize != m_stamp.size || record.snapshotMtime != mtimeTicks(m_stamp)) {
+            generation++;
+        }
+    }
+
+    m_generation = generation + m_writing.size() + m_pending.size();
+}
+
+void FileTokenBackend::writeGeneration(bool sync) {
+    // every write to the files ends up here, other copies have to revalidate even if this fails.
+    // writes only happen with an up to date cache, so ours stays in sync
+    auto& shared = ArgonState::get().storageGeneration();
+    shared.bump();
+    m_syncedGeneration = shared.load();
+
+    GenerationRecord record {
+        .generation = m_generation,
+        .snapshotSize = m_stamp.size,
+        .snapshotMtime = mtimeTicks(m_stamp),
+        .legacyWriteAt = m_legacyWriteAt,
+    };
+
+    if (auto err = m_generationFile.write(record, sync).err()) {
+        log::warn("(Argon) failed to write storage generation: {}", *err);
+        this->syncDiskTag(this->readDiskTag());
+    } else {
+        m_metrics.bytesWritten += GenerationFile::SIZE;
+        // our own write must not look like someone else's to the next lookup
+        this->syncDiskTag(diskTag(m_stamp, record));
+    }
+}
+
+bool FileTokenBackend::needsPruning() const {
+    int64_t cutoff = unixNow() - TOKEN_TTL.count();
+    size_t count = 0;
+    bool expired = false;
+
+    this->forEachToken([&](const TokenView& token) {
+        count++;
+        // tokens without a timestamp only start expiring once the snapshot is rewritten with one
+        expired |= token.lastUsedAt != 0 && token.lastUsedAt < cutoff;
+    });
+
+    return expired || count > m_maxTokens.load(std::memory_order::relaxed);
+}
+
+void FileTokenBackend::enqueue(std::vector<uint8_t> record) {
+    m_generation++;
+    m_metrics.mutations++;
+    m_pending.push_back(std::move(record));
+
+    this->scheduleFlush();
+}
+
+void FileTokenBackend::scheduleFlush() {
+    // lookups can get here without holding the config lock
+    std::call_once(m_workerOnce, [this] {
+        // never freed, the worker thread runs until the game exits
+        m_worker = new FlushWorker([this] {
+            this->flush();
+        }, FLUSH_DELAY);
+    });
+
+    m_worker->notify();
+}
+
+std::optional<FileTokenBackend::PendingWrite> FileTokenBackend::prepareWrite() {
+    bool compact = (m_journalUsable && m_journalOffset > COMPACTION_THRESHOLD) || m_snapshotDue;
+    if (m_pending.empty() && !compact) {
+        return std::nullopt;
+    }
+
+    PendingWrite write {
+        // older Argon versions only read the snapshot, while they're around it has to be kept up to date
+        .snapshot = compact || !m_journalUsable || this->legacyWriterActive(),
+        .resetJournal = m_journalUsable,
+        .record = {
+            .generation = m_generation,
+            .snapshotSize = m_stamp.size,
+            .snapshotMtime = mtimeTicks(m_stamp),
+            .legacyWriteAt = m_legacyWriteAt,
+        },
+        .loadEpoch = m_loadEpoch,
+    };
+
+    // everything that was queued since the last flush goes out as one group commit.
+    // until it's written, the records are reapplied like pending ones whenever the cache is reloaded
+    m_writing = std::move(m_pending);
+    m_pending.clear();
+
+    if (!write.snapshot) {
+        return write;
+    }
+
+    m_snapshotDue = false;
+    int64_t now = unixNow();
+
+    std::vector<TokenView> tokens;
+    this->forEachToken([&](TokenView token) {
+        if (token.createdAt == 0) token.createdAt = now;
+        if (token.lastUsedAt == 0) token.lastUsedAt = now;
+        tokens.push_back(token);
+    });
+
+    // drop expired tokens, and then the least recently used ones until we're within the limit
+    std::erase_if(tokens, [&](const TokenView& token) {
+        return token.lastUsedAt < now - TOKEN_TTL.count();
+    });
+
+    size_t maxTokens = m_maxTokens.load(std::memory_order::relaxed);
+    if (tokens.size() > maxTokens) {
+        std::nth_element(tokens.begin(), tokens.begin() + maxTokens, tokens.end(), [](const TokenView& a, const TokenView& b) {
+            return a.lastUsedAt > b.lastUsedAt;
+        });
+        tokens.resize(maxTokens);
+    }
+
+    auto arr = matjson::Value::array();
+    auto& vec = arr.asArray().unwrap();
+
+    vec.reserve(tokens.size());
+
+    for (auto& token : tokens) {
+        vec.push_back(matjson::makeObject({
+            {"url", token.url},
+            {"accid", token.accountId},
+            {"userid", token.userId},
+            {"name", token.name},
+            {"ident", token.ident},
+            {"token", token.token},
+            {"created", token.createdAt},
+            {"lastUsed", token.lastUsedAt},
+        }));
+    }
+
+    auto data = matjson::makeObject({
+        {"_ver", m_generation},
+        {"tokens", std::move(arr)},
+    });
+
+    write.json = data.dump();
+
+    if (m_useBinaryStore) {
+        write.binary = BinaryTokenStore::encode(tokens, m_generation);
+    } else {
+        // the index has to match the snapshot, dropped tokens are not recorded anywhere else
+        auto& index = write.index.emplace();
+        for (auto& token : tokens) {
+            index.upsert(toStored(token));
+        }
+    }
+
+    return write;
+}
+
+FileTokenBackend::WriteResult FileTokenBackend::performWrite(PendingWrite& write) {
+    WriteResult out;
+
+    if (write.snapshot) {
+        bool sync = FSYNC_POLICY != FsyncPolicy::None;
+
+        // written to a temporary file first, so a crash can never leave a half written file behind
+        auto res = writeFileAtomic(m_path, std::span{reinterpret_cast<const uint8_t*>(write.json.data()), write.json.size()}, sync);
+        if (!res) {
+            out.result = Err(fmt::format("failed to save argon data file: {}", res.unwrapErr()));
+            return out;
+        }
+
+        out.stamp = statFile(m_path);
+        out.bytesWritten += write.json.size();
+        write.record.snapshotSize = out.stamp.size;
+        write.record.snapshotMtime = mtimeTicks(out.stamp);
+
+        // everything in the journal and all pending changes are now part of the snapshot
+        if (write.resetJournal) {
+            if (auto err = m_journal.reset(sync).err()) {
+                log::warn("(Argon) failed to reset token journal: {}", *err);
+            }
+
+            out.bytesWritten += TokenJournal::HEADER_SIZE;
+        }
+    } else {
+        auto res = m_journal.append(m_writing, FSYNC_POLICY == FsyncPolicy::Always);
+        if (!res) {
+            out.result = Err(fmt::format("failed to append to token journal, rewriting snapshot: {}", res.unwrapErr()));
+            return out;
+        }
+
+        out.bytesWritten += res.unwrap();
+    }
+
+    out.journalStamp = statFile(m_journal.path());
+
+    // written last, if a crash gets in the way the snapshot won't match the generation file and the next load bumps the generation
+    bool sync = write.snapshot ? FSYNC_POLICY != FsyncPolicy::None : FSYNC_POLICY == FsyncPolicy::Always;
+    if (auto err = m_generationFile.write(write.record, sync).err()) {
+        log::warn("(Argon) failed to write storage generation: {}", *err);
+    } else {
+        out.generationWritten = true;
+        out.bytesWritten += GenerationFile::SIZE;
+    }
+
+    return out;
+}
+
+bool FileTokenBackend::commitWrite(PendingWrite& write, WriteResult result) {
+    if (!result.result) {
+        log::warn("(Argon) {}", result.result.unwrapErr());
+
+        // the records go back in front of whatever was queued in the meantime, the next flush rewrites the snapshot.
+        // a failed journal append is retried that way right away, a failed snapshot waits for the next change
+        m_writing.insert(m_writing.end(), std::make_move_iterator(m_pending.begin()), std::make_move_iterator(m_pending.end()));
+        m_pending = std::move(m_writing);
+        m_writing.clear();
+        m_snapshotDue = true;
+
+        if (!write.snapshot) {
+            this->scheduleFlush();
+        }
+
+        return false;
+    }
+
+    m_writing.clear();
+    m_metrics.commits++;
+    m_metrics.bytesWritten += result.bytesWritten;
+
+    // someone reloaded the cache after the files were written (which needs the legacy mutex, held while writing),
+    // so it already matches them. otherwise the cache is exactly what was written, plus the changes made in the meantime
+    bool compact = false;
+    if (m_loadEpoch == write.loadEpoch) {
+        if (write.snapshot) {
+            m_stamp = result.stamp;
+            m_snapshotGeneration = write.record.generation;
+
+            if (write.index) {
+                m_index = std::move(*write.index);
+                for (auto& record : m_pending) {
+                    TokenJournal::apply(m_index, record);
+                }
+            }
+        } else {
+            compact = m_journalUsable && result.journalStamp.size > COMPACTION_THRESHOLD;
+        }
+
+        if (write.resetJournal || !write.snapshot) {
+            m_journalStamp = result.journalStamp;
+            m_journalOffset = m_journalStamp.size;
+        }
+
+        // our own write must not look like someone else's to the next lookup
+        this->syncDiskTag(result.generationWritten ? diskTag(m_stamp, write.record) : this->readDiskTag());
+    }
+
+    // every write to the files ends up here, other copies have to revalidate even if the generation file couldn't be written
+    auto& shared = ArgonState::get().storageGeneration();
+    shared.bump();
+    m_syncedGeneration = shared.load();
+
+    if (m_useBinaryStore && write.snapshot) {
+        // the views point into the old mapping, which has to be released before the file can be replaced
+        m_base.reset();
+
+        size_t binarySize = write.binary.size();
+        if (auto err = BinaryTokenStore::write(m_binaryPath, std::move(write.binary), m_stamp.size, mtimeTicks(m_stamp)).err()) {
+            log::warn("(Argon) failed to write binary token store: {}", *err);
+        } else {
+            m_metrics.bytesWritten += binarySize;
+        }
+
+        // maps the new binary store, or rebuilds it from the JSON snapshot if writing failed
+        this->reload(m_stamp);
+        this->reapplyPending();
+    }
+
+    this->rebuildFilter();
+    return compact;
+}
+
+void FileTokenBackend::flush() {
+    // one flush at a time, the files are written without the reader-writer lock
+    std::lock_guard writer(m_writeMutex);
+
+    // an append can push the journal past the compaction threshold, it's then compacted right away
+    while (this->writeOnce()) {}
+}
+
+bool FileTokenBackend::writeOnce() {
+    auto lock = ArgonState::get().acquireConfigLock(LockSite::Flush);
+
+    // catch up with other mods first, so our records land after theirs
+    this->revalidate();
+    this->applyTouches();
+
+    auto write = this->prepareWrite();
+    if (!write) {
+        return false;
+    }
+
+    if (m_useBinaryStore && write->snapshot) {
+        // the mapped binary store gets replaced, which lookups can't be around for
+        auto result = this->performWrite(*write);
+        return this->commitWrite(*write, std::move(result));
+    }
+
+    // lookups and changes only need the reader-writer lock, older Argon versions keep waiting for the legacy mutex
+    lock.timer.stop();
+    lock.rw.unlock();
+    auto result = this->performWrite(*write);
+    lock.legacy.unlock();
+
+    auto _lock = ArgonState::get().acquireConfigLock(LockSite::Flush);
+    return this->commitWrite(*write, std::move(result));
+}
+
+Result<> FileTokenBackend::upsert(TokenKeyView key, std::string_view username, std::string_view serverIdent, std::string_view authtoken) {
+    // only the cache is changed here, it doesn't have to be up to date as the storage worker revalidates before writing
+    auto _lock = ArgonState::get().acquireCacheLock(LockSite::Store);
+
+    // if there's a token with the same url and account, its ident, username and token get replaced
+    int64_t now = unixNow();
+    StoredToken token {
+        .url = std::string{key.url},
+        .accountId = key.accountId,
+        .userId = key.userId,
+        .name = std::string{username},
+        .ident = std::string{serverIdent},
+        .token = std::string{authtoken},
+        .createdAt = now,
+        .lastUsedAt = now,
+    };
+
+    this->enqueue(TokenJournal::encodeUpsert(token));
+
+    m_filter.insert(key.url, key.accountId);
+
+    bool inserted = m_index.upsert(std::move(token));
+    if (inserted && m_index.size() + (m_base ? m_base->size() : 0) > m_maxTokens.load(std::memory_order::relaxed)) {
+        m_snapshotDue = true;
+    }
+
+    return Ok();
+}
+
+std::optional<std::string> FileTokenBackend::get(TokenKeyView key, std::string_view username) {
+    // most lookups at startup are for accounts that never authenticated
+    if (this->definitelyMissing(key)) {
+        return std::nullopt;
+    }
+
+    int64_t now = unixNow();
+    bool touch = false;
+
+    auto out = this->withFreshCache([&]() -> std::optional<std::string> {
+        auto token = this->findToken(key);
+
+        // skip tokens that were issued under a different username
+        if (!token || token->name != username) {
+            return std::nullopt;
+        }
+
+        touch = needsTouch(*token, now);
+        return std::string{token->token};
+    }, [&]() -> Result<std::optional<std::string>> {
+        // last use time is updated once the cache is loaded
+        GEODE_UNWRAP_INTO(auto token, this->scanForToken(key));
+
+        if (!token || token->name != username) {
+            return Ok(std::nullopt);
+        }
+
+        return Ok(std::move(token->token));
+    });
+
+    if (touch) {
+        this->queueTouches(std::span{&key, 1});
+    }
+
+    return out;
+}
+
+std::vector<std::optional<std::string>> FileTokenBackend::getMany(std::span<const TokenQuery> queries) {
+    bool anyCandidates = std::ranges::any_of(queries, [&](const TokenQuery& query) {
+        return !this->definitelyMissing(query.key);
+    });
+
+    if (!anyCandidates) {
+        return std::vector<std::optional<std::string>>(queries.size());
+    }
+
+    int64_t now = unixNow();
+    std::vector<TokenKeyView> touched;
+
+    auto out = this->withFreshCache([&] {
+        std::vector<std::optional<std::string>> out(queries.size());
+
+        for (size_t i = 0; i < queries.size(); i++) {
+            auto token = this->findToken(queries[i].key);
+            if (token && token->name == queries[i].username) {
+                out[i].emplace(token->token);
+
+                if (needsTouch(*token, now)) {
+                    touched.push_back(queries[i].key);
+                }
+            }
+        }
+
+        return out;
+    });
+
+    if (!touched.empty()) {
+        this->queueTouches(touched);
+    }
+
+    return out;
+}
+
+void FileTokenBackend::queueTouches(std::span<const TokenKeyView> keys) {
+    {
+        std::lock_guard lock(m_touchMutex);
+
+        for (auto& key : keys) {
+            // the same token is usually looked up many times before the worker gets to it
+            bool queued = std::ranges::any_of(m_touched, [&](const TouchedKey& other) {
+                return other.accountId == key.accountId && other.userId == key.userId && other.url == key.url;
+            });
+
+            if (!queued) {
+                m_touched.push_back({std::string{key.url}, key.accountId, key.userId});
+            }
+        }
+    }
+
+    this->scheduleFlush();
+}
+
+void FileTokenBackend::applyTouches() {
+    std::vector<TouchedKey> touched;
+    {
+        std::lock_guard lock(m_touchMutex);
+        touched.swap(m_touched);
+    }
+
+    int64_t now = unixNow();
+    for (auto& entry : touched) {
+        TokenKeyView key{entry.url, entry.accountId, entry.userId};
+        auto token = this->findToken(key);
+        // another thread could have touched it in the meantime
+        if (!token || !needsTouch(*token, now)) {
+            continue;
+        }
+
+        auto stored = toStored(*token);
+        stored.lastUsedAt = now;
+
+        this->enqueue(TokenJournal::encodeTouch(stored));
+        m_filter.insert(key.url, key.accountId);
+        m_index.upsert(std::move(stored));
+    }
+}
+
+void FileTokenBackend::eraseAccounts(std::string_view url, std::span<const int> accountIds) {
+    auto _lock = ArgonState::get().acquireCacheLock(LockSite::Clear);
+
+    // an out of date cache could be missing tokens that are on disk, those have to be erased as well
+    bool upToDate = this->upToDate();
+
+    for (int accountId : accountIds) {
+        bool inBase = m_base && !m_index.masks({url, accountId, 0}) && m_base->containsAccount(url, accountId);
+
+        if (m_index.eraseAccount(url, accountId) == 0 && !inBase && upToDate) {
+            // nothing to remove
+            continue;
+        }
+
+        this->enqueue(TokenJournal::encodeEraseAccount(url, accountId));
+    }
+}
+
+void FileTokenBackend::eraseServer(std::string_view url) {
+    auto _lock = ArgonState::get().acquireCacheLock(LockSite::Clear);
+
+    m_index.eraseServer(url);
+
+    this->enqueue(TokenJournal::encodeEraseServer(url));
+}
+
+void FileTokenBackend::prewarm() {
+    auto _lock = ArgonState::get().acquireConfigLock(LockSite::Load);
+
+    // unlike lookups, this always loads the whole cache instead of scanning the files for a single token
+    this->revalidate();
+}
+
+StorageMetrics FileTokenBackend::metrics() {
+    auto _lock = ArgonState::get().acquireConfigReadLock(LockSite::Other);
+    return m_metrics;
+}
+
+void FileTokenBackend::requestMaxTokens(size_t count) {
+    size_t current = m_maxTokens.load(std::memory_order::relaxed);
+    while (current < count && !m_maxTokens.compare_exchange_weak(current, count, std::memory_order::relaxed)) {}
+}
+
+uint64_t FileTokenBackend::generation() {
+    return this->withFreshCache([&] {
+        return m_generation;
+    });
+}
+
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include "BinaryTokenStore.hpp"
+#include "FileIO.hpp"
+#include "FlushWorker.hpp"
+#include "GenerationFile.hpp"
+#include "TokenBackend.hpp"
+#include "TokenFilter.hpp"
+#include "TokenJournal.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+
+#ifndef ARGON_MAX_STORED_TOKENS
+# define ARGON_MAX_STORED_TOKENS 128
+#endif
+
+namespace argon {
+
+// Identifies the state of a data file on disk, if the stamp did not change then the cached tokens are up to date
+struct StorageStamp {
+    bool exists = false;
+    std::filesystem::file_time_type mtime{};
+    uintmax_t size = 0;
+
+    bool operator==(const StorageStamp&) const = default;
+};
+
+// Token storage backed by a JSON snapshot, which is also read and written by older Argon versions,
+// plus a journal of changes made since the snapshot was written (same name, `.journal` extension),
+// a sidecar with the storage generation (`.gen` extension) and optionally a memory-mapped binary copy of the snapshot (`.bin` extension).
+//
+// All file access happens under the config lock, which is shared by every Argon copy in the process.
+// Changes are applied to the in-memory cache right away and written by a background worker,
+// which only holds the legacy mutex while writing, so that lookups and changes don't wait for the disk.
+//
+// The journal is only applied if the generation file says it was written on top of the current snapshot.
+// Older versions rewrite the snapshot without knowing about the journal, in which case the journal is dropped,
+// except for the tokens that were only ever stored in it.
+class FileTokenBackend : public TokenBackend {
+public:
+    // Once the journal grows past this size, it gets merged into the JSON snapshot
+    static constexpr uint64_t COMPACTION_THRESHOLD = 32 * 1024;
+    // How long the storage worker waits for more changes before writing them
+    static constexpr std::chrono::milliseconds FLUSH_DELAY{100};
+    // Journal appends are not synced, losing the latest changes to a power loss only means having to authenticate again
+    static constexpr FsyncPolicy FSYNC_POLICY = FsyncPolicy::Snapshots;
+    // Once there are more tokens than this, the least recently used ones are dropped on the next compaction.
+    // The storage is shared by all Argon copies in the process, so this is only the limit that this copy asks for (see `requestMaxTokens`)
+    static constexpr size_t MAX_STORED_TOKENS = ARGON_MAX_STORED_TOKENS;
+    // Tokens that were not used for this long are dropped on the next compaction
+    static constexpr std::chrono::seconds TOKEN_TTL = std::chrono::days{90};
+    // The last use time of a token is only written to disk if it's older than this, so that lookups stay read-only
+    static constexpr std::chrono::seconds TOUCH_INTERVAL = std::chrono::hours{1};
+    // Lookups look at the files on disk at most this often. Writes by Argon copies in this process are seen right away,
+    // writes by other processes or older Argon versions (which only show up on disk) can take this long to be seen
+    static constexpr std::chrono::milliseconds DISK_CHECK_INTERVAL{250};
+    // Once an older Argon version was seen rewriting the snapshot, every flush rewrites the snapshot for this long
+    // instead of appending to the journal, so that those versions see our tokens.
+    // A snapshot without a generation file counts as well, which is what upgrading from an older version leaves behind
+    static constexpr std::chrono::seconds LEGACY_WRITER_WINDOW = std::chrono::days{30};
+
+    // Must never be destroyed once used, the storage worker keeps a pointer to it
+    FileTokenBackend(std::filesystem::path path, bool binaryStore);
+
+    std::optional<std::string> get(TokenKeyView key, std::string_view username) override;
+    std::vector<std::optional<std::string>> getMany(std::span<const TokenQuery> queries) override;
+    geode::Result<> upsert(TokenKeyView key, std::string_view username, std::string_view serverIdent, std::string_view authtoken) override;
+    void eraseAccounts(std::string_view url, std::span<const int> accountIds) override;
+    void eraseServer(std::string_view url) override;
+
+    uint64_t generation() override;
+    void requestMaxTokens(size_t count) override;
+    // Blocks until all pending changes are written to disk
+    void flush() override;
+    StorageMetrics metrics() override;
+    void prewarm() override;
+
+private:
+    std::filesystem::path m_path;
+    std::filesystem::path m_binaryPath;
+    const bool m_useBinaryStore;
+
+    // mirror of the JSON snapshot as of `m_stamp` with the journal applied up to `m_journalOffset`.
+    // when the binary store is in use, the snapshot is served from `m_base` and the index only holds changes on top of it
+    TokenIndex m_index;
+    std::optional<BinaryTokenStore> m_base;
+    TokenJournal m_journal;
+    GenerationFile m_generationFile;
+    StorageStamp m_stamp;
+    StorageStamp m_journalStamp;
+    uint64_t m_journalOffset = 0;
+    // generation of the cache including pending changes, and the one recorded in the snapshot as of `m_stamp`
+    uint64_t m_generation = 0;
+    uint64_t m_snapshotGeneration = 0;
+    // shared storage generation (see `SharedStorageGenerationV1`) and disk tag (see `readDiskTag`)
+    // that the cache was last brought up to date at
+    uint64_t m_syncedGeneration = 0;
+    uint64_t m_syncedDiskTag = 0;
+    // latest disk tag seen by a lookup and when it was read (steady clock ticks), see `DISK_CHECK_INTERVAL`
+    mutable std::atomic<uint64_t> m_diskTag = 0;
+    mutable std::atomic<int64_t> m_diskCheckedAt = 0;
+    bool m_loaded = false;
+    // false if the journal was written by an incompatible Argon version, every flush then rewrites the snapshot
+    bool m_journalUsable = true;
+    // largest limit asked for by any Argon copy, only ever grows
+    std::atomic<size_t> m_maxTokens = MAX_STORED_TOKENS;
+    // whether the next flush has to rewrite the snapshot, because there are expired tokens or more than `m_maxTokens`
+    // or because appending to the journal failed
+    bool m_snapshotDue = false;
+    // bumped whenever the cache is brought up to date with changes on disk, see `commitWrite`
+    uint64_t m_loadEpoch = 0;
+    // unix time at which an older Argon version was last seen rewriting the snapshot, see `LEGACY_WRITER_WINDOW`
+    int64_t m_legacyWriteAt = 0;
+    // encoded journal records that are applied to the index but not yet written to disk, and the ones being written right now
+    std::vector<std::vector<uint8_t>> m_pending;
+    std::vector<std::vector<uint8_t>> m_writing;
+    // only one flush at a time, taken before the config lock
+    std::mutex m_writeMutex;
+    FlushWorker* m_worker = nullptr;
+    std::once_flag m_workerOnce;
+    StorageMetrics m_metrics;
+    // every account that has a token in the cache, tagged with the storage generation and disk tag it was built at.
+    // lets lookups for accounts without tokens skip the config lock entirely
+    TokenFilter m_filter{MAX_STORED_TOKENS};
+
+    struct TouchedKey {
+        std::string url;
+        int accountId;
+        int userId;
+    };
+
+    // tokens whose last use time is due for an update, queued by lookups (which only hold the read lock, if any)
+    // and written by the storage worker along with the other changes
+    std::mutex m_touchMutex;
+    std::vector<TouchedKey> m_touched;
+
+    // Whether the storage is unchanged since the last load, see `DISK_CHECK_INTERVAL`. Read lock must be held.
+    bool upToDate() const;
+    // Describes the files on disk with a single small read of the generation file plus a stat of the snapshot,
+    // which covers writes by every Argon version in any process
+    uint64_t readDiskTag() const;
+    // Same, but reuses the last tag if it was read within `DISK_CHECK_INTERVAL`. Takes no lock
+    uint64_t currentDiskTag() const;
+    // Records the disk tag that the cache is now in sync with. Config lock must be held.
+    void syncDiskTag(uint64_t tag);
+    // Reloads the tokens from disk if the files were changed since the last load. Config lock must be held.
+    void revalidate();
+    // Runs `func` under the read lock, unless the cache has to be reloaded first, which happens under the write lock
+    template <typename F>
+    auto withFreshCache(F&& func);
+    // Same, but runs `cold` under the write lock instead of loading the cache first, unless it fails
+    template <typename F, typename C>
+    auto withFreshCache(F&& func, C&& cold);
+    void reload(StorageStamp stamp);
+    void loadJsonSnapshot();
+    // Finds a single token by streaming through the files on disk, without loading them. Config lock must be held.
+    geode::Result<std::optional<StoredToken>> scanForToken(TokenKeyView key);
+    void openBinaryStore();
+    void importIntoBinaryStore();
+    void replayJournal(uint64_t offset);
+    // Empties the journal after the snapshot was found written by someone else, carrying over the tokens that only existed in it.
+    // `record` is the generation file if there is one
+    void discardJournal(const std::optional<GenerationRecord>& record);
+    bool legacyWriterActive() const;
+    void reapplyPending();
+    // Sets the generation from the generation file after the cache was reloaded. Config lock must be held.
+    void syncGeneration();
+    void writeGeneration(bool sync);
+    // Refills the filter from the cache, must be called whenever tokens are removed or the files on disk change.
+    // Config lock must be held.
+    void rebuildFilter();
+    // Whether this account definitely has no token, checked without taking any lock.
+    // False means that it might have one, or that the cache is out of date and has to be checked the slow way
+    bool definitelyMissing(TokenKeyView key) const;
+
+    std::optional<TokenView> findToken(TokenKeyView key) const;
+    template <typename F>
+    void forEachToken(F&& func) const;
+
+    bool needsPruning() const;
+    // Queues an update of the last use time of these tokens for the storage worker. Takes no config lock
+    void queueTouches(std::span<const TokenKeyView> keys);
+    // Updates the last use time of the queued tokens, if it's older than `TOUCH_INTERVAL`. Config lock must be held.
+    void applyTouches();
+
+    // Queues a record for a mutation that was already applied to the index. Cache lock must be held.
+    void enqueue(std::vector<uint8_t> record);
+    void scheduleFlush();
+
+    // Everything a flush writes, taken from the cache under the config lock
+    struct PendingWrite {
+        // rewrite the snapshot (and empty the journal) rather than appending `m_writing` to the journal
+        bool snapshot = false;
+        bool resetJournal = false;
+        std::string json;
+        std::vector<uint8_t> binary;
+        // the cache as of the new snapshot, without the expired and excess tokens
+        std::optional<TokenIndex> index;
+        GenerationRecord record;
+        uint64_t loadEpoch = 0;
+    };
+
+    struct WriteResult {
+        geode::Result<> result = geode::Ok();
+        bool generationWritten = false;
+        StorageStamp stamp;
+        StorageStamp journalStamp;
+        uint64_t bytesWritten = 0;
+    };
+
+    // Moves the pending records into `m_writing` and builds whatever has to be written, nullopt if there's nothing to do.
+    // Config lock must be held.
+    std::optional<PendingWrite> prepareWrite();
+    // Writes the files. Only needs the legacy mutex, as it only uses what `prepareWrite` built
+    WriteResult performWrite(PendingWrite& write);
+    // Records what was written in the cache, or puts the records back if writing failed.
+    // Returns whether the journal has to be compacted. Config lock must be held.
+    bool commitWrite(PendingWrite& write, WriteResult result);
+    // Writes whatever is pending, returns whether another round is needed. Takes the config lock
+    bool writeOnce();
+};
+
+}
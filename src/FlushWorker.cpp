@@ -0,0 +1,44 @@
+#include "FlushWorker.hpp"
+
+#include <thread>
+
+namespace argon {
+
+FlushWorker::FlushWorker(std::function<void()> callback, std::chrono::milliseconds delay)
+    : m_callback(std::move(callback)), m_delay(delay)
+{
+    std::thread([this] {
+        this->run();
+    }).detach();
+}
+
+void FlushWorker::notify() {
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_scheduled) return;
+        m_scheduled = true;
+    }
+
+    m_cv.notify_one();
+}
+
+void FlushWorker::run() {
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_scheduled; });
+        }
+
+        // let more changes pile up before writing
+        std::this_thread::sleep_for(m_delay);
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_scheduled = false;
+        }
+
+        m_callback();
+    }
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace argon {
+
+// Background thread that runs a callback shortly after being notified, so that a burst of changes is written all at once.
+// Meant to live until the process exits, so it should be heap allocated and never destroyed.
+class FlushWorker {
+public:
+    FlushWorker(std::function<void()> callback, std::chrono::milliseconds delay);
+
+    FlushWorker(const FlushWorker&) = delete;
+    FlushWorker& operator=(const FlushWorker&) = delete;
+
+    // Schedules a run of the callback, does nothing if one is already scheduled
+    void notify();
+
+private:
+    std::function<void()> m_callback;
+    std::chrono::milliseconds m_delay;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_scheduled = false;
+
+    void run();
+};
+
+}
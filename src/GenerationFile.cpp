@@ -0,0 +1,58 @@
+#include "GenerationFile.hpp"
+#include "FileIO.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+using geode::Ok;
+using geode::Err;
+
+namespace argon {
+
+static_assert(std::endian::native == std::endian::little, "generation file assumes a little endian platform");
+
+static constexpr char GENERATION_MAGIC[4] = {'A', 'R', 'G', 'G'};
+
+GenerationFile::GenerationFile(std::filesystem::path path) : m_path(std::move(path)) {}
+
+const std::filesystem::path& GenerationFile::path() const {
+    return m_path;
+}
+
+geode::Result<GenerationRecord> GenerationFile::read() const {
+    std::array<uint8_t, SIZE> data;
+    GEODE_UNWRAP_INTO(size_t size, readFilePrefix(m_path, data));
+
+    if (size != SIZE || std::memcmp(data.data(), GENERATION_MAGIC, sizeof(GENERATION_MAGIC)) != 0) {
+        return Err("invalid generation file");
+    }
+
+    uint32_t version;
+    std::memcpy(&version, data.data() + 4, sizeof(version));
+    if (version != VERSION) {
+        return Err("unsupported generation file version {}", version);
+    }
+
+    GenerationRecord out;
+    std::memcpy(&out.generation, data.data() + 8, 8);
+    std::memcpy(&out.snapshotSize, data.data() + 16, 8);
+    std::memcpy(&out.snapshotMtime, data.data() + 24, 8);
+    std::memcpy(&out.legacyWriteAt, data.data() + 32, 8);
+
+    return Ok(out);
+}
+
+geode::Result<> GenerationFile::write(const GenerationRecord& record, bool sync) const {
+    std::array<uint8_t, SIZE> data;
+    std::memcpy(data.data(), GENERATION_MAGIC, sizeof(GENERATION_MAGIC));
+    std::memcpy(data.data() + 4, &VERSION, sizeof(VERSION));
+    std::memcpy(data.data() + 8, &record.generation, 8);
+    std::memcpy(data.data() + 16, &record.snapshotSize, 8);
+    std::memcpy(data.data() + 24, &record.snapshotMtime, 8);
+    std::memcpy(data.data() + 32, &record.legacyWriteAt, 8);
+
+    return writeFileAtomic(m_path, data, sync);
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Geode/Result.hpp>
+#include <filesystem>
+#include <stdint.h>
+
+namespace argon {
+
+struct GenerationRecord {
+    // changes (increases) every time a mutation is committed to the storage
+    uint64_t generation = 0;
+    // size + mtime of the JSON snapshot as of that commit, a mismatch means the snapshot was written by an older Argon version
+    uint64_t snapshotSize = 0;
+    int64_t snapshotMtime = 0;
+    // unix time at which the snapshot was last found rewritten by an older Argon version, 0 if never
+    int64_t legacyWriteAt = 0;
+};
+
+// Small sidecar of the token storage (same name, `.gen` extension) that holds the storage generation,
+// so that any cache of the storage can be validated with a single small read instead of parsing anything.
+//
+// Layout: "ARGG", u32 format version, then the fields of `GenerationRecord` in order, all integers little endian.
+// The file is always replaced atomically, so readers never see a partial write.
+class GenerationFile {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t SIZE = 40;
+
+    explicit GenerationFile(std::filesystem::path path);
+
+    const std::filesystem::path& path() const;
+
+    geode::Result<GenerationRecord> read() const;
+    geode::Result<> write(const GenerationRecord& record, bool sync) const;
+
+private:
+    std::filesystem::path m_path;
+};
+
+}
@@ -0,0 +1,139 @@
+#include "LockStats.hpp"
+
+#include <Geode/loader/Mod.hpp>
+#include <Geode/utils/thread.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+
+namespace argon {
+
+static size_t histogramBucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    if (us == 0) return 0;
+
+    return std::min<size_t>(std::bit_width(us) - 1, LOCK_HISTOGRAM_BUCKETS - 1);
+}
+
+static void copyTruncated(char* out, size_t outSize, std::string_view str) {
+    size_t len = std::min(str.size(), outSize - 1);
+    std::memcpy(out, str.data(), len);
+    out[len] = '\0';
+}
+
+LockStatsRecorder* LockStatsRecorder::create() {
+    auto ret = new LockStatsRecorder();
+    ret->autorelease();
+    return ret;
+}
+
+bool LockStatsRecorder::enabled() {
+    return m_enabled.load(std::memory_order::relaxed);
+}
+
+void LockStatsRecorder::setEnabled(bool enabled) {
+    m_enabled.store(enabled, std::memory_order::relaxed);
+}
+
+void LockStatsRecorder::record(LockSite site, bool exclusive, bool contended, uint64_t waitNs, uint64_t holdNs, AbiString modId, AbiString thread) {
+    size_t idx = static_cast<size_t>(site);
+    if (idx >= LOCK_SITE_COUNT) return;
+
+    std::lock_guard lock(m_mutex);
+
+    auto& stats = m_stats.sites[idx];
+    stats.acquisitions++;
+    stats.contended += contended;
+    stats.totalWaitNs += waitNs;
+    stats.totalHoldNs += holdNs;
+    stats.maxWaitNs = std::max(stats.maxWaitNs, waitNs);
+    stats.maxHoldNs = std::max(stats.maxHoldNs, holdNs);
+    stats.waitHistogram[histogramBucket(waitNs)]++;
+    stats.holdHistogram[histogramBucket(holdNs)]++;
+
+    // keep the longest holds sorted, longest first
+    auto& worst = m_stats.worst;
+    size_t& count = m_stats.worstCount;
+
+    if (count == LOCK_WORST_HOLDS && worst[count - 1].holdNs >= holdNs) {
+        return;
+    }
+
+    size_t pos = count < LOCK_WORST_HOLDS ? count++ : count - 1;
+    while (pos > 0 && worst[pos - 1].holdNs < holdNs) {
+        worst[pos] = worst[pos - 1];
+        pos--;
+    }
+
+    auto& hold = worst[pos];
+    hold.site = site;
+    hold.exclusive = exclusive;
+    hold.waitNs = waitNs;
+    hold.holdNs = holdNs;
+    copyTruncated(hold.modId, sizeof(hold.modId), modId);
+    copyTruncated(hold.thread, sizeof(hold.thread), thread);
+}
+
+void LockStatsRecorder::snapshot(LockStats* out) {
+    std::lock_guard lock(m_mutex);
+    *out = m_stats;
+}
+
+void LockStatsRecorder::reset() {
+    std::lock_guard lock(m_mutex);
+    m_stats = {};
+}
+
+// empty unless the current thread is handling a call forwarded by another Argon copy
+static thread_local std::string_view g_callerModId;
+
+LockCallerScope::LockCallerScope(std::string_view modId) : m_previous(std::exchange(g_callerModId, modId)) {}
+
+LockCallerScope::~LockCallerScope() {
+    g_callerModId = m_previous;
+}
+
+static uint64_t nanosBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+LockHoldTimer::LockHoldTimer(SharedLockStatsV1* stats, LockSite site, bool exclusive, bool contended, std::chrono::steady_clock::time_point start)
+    : m_stats(stats),
+      m_site(site),
+      m_exclusive(exclusive),
+      m_contended(contended),
+      m_acquired(std::chrono::steady_clock::now())
+{
+    m_waitNs = nanosBetween(start, m_acquired);
+}
+
+LockHoldTimer::LockHoldTimer(LockHoldTimer&& other) noexcept
+    : m_stats(std::exchange(other.m_stats, nullptr)),
+      m_site(other.m_site),
+      m_exclusive(other.m_exclusive),
+      m_contended(other.m_contended),
+      m_waitNs(other.m_waitNs),
+      m_acquired(other.m_acquired),
+      m_released(other.m_released) {}
+
+void LockHoldTimer::stop() {
+    if (m_stats && m_released == std::chrono::steady_clock::time_point{}) {
+        m_released = std::chrono::steady_clock::now();
+    }
+}
+
+LockHoldTimer::~LockHoldTimer() {
+    if (!m_stats) return;
+
+    this->stop();
+    uint64_t holdNs = nanosBetween(m_acquired, m_released);
+
+    static const std::string ownModId = geode::Mod::get()->getID();
+    std::string_view modId = g_callerModId.empty() ? std::string_view{ownModId} : g_callerModId;
+    auto thread = geode::utils::thread::getName();
+
+    m_stats->record(m_site, m_exclusive, m_contended, m_waitNs, holdNs, modId, thread);
+}
+
+}
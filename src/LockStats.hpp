@@ -0,0 +1,80 @@
+#pragma once
+#include "SharedTokenCache.hpp"
+
+#include <argon/argon.hpp>
+#include <cocos2d.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string_view>
+
+namespace argon {
+
+// Config lock statistics, shared by every Argon copy in the process through a GameManager user object, like the lock itself.
+//
+// This is an ABI boundary, the same rules as for `SharedTokenCacheV1` apply.
+class SharedLockStatsV1 : public cocos2d::CCObject {
+public:
+    virtual bool enabled() = 0;
+    virtual void setEnabled(bool enabled) = 0;
+    virtual void record(LockSite site, bool exclusive, bool contended, uint64_t waitNs, uint64_t holdNs, AbiString modId, AbiString thread) = 0;
+    virtual void snapshot(LockStats* out) = 0;
+    virtual void reset() = 0;
+};
+
+class LockStatsRecorder : public SharedLockStatsV1 {
+public:
+    static LockStatsRecorder* create();
+
+    bool enabled() override;
+    void setEnabled(bool enabled) override;
+    void record(LockSite site, bool exclusive, bool contended, uint64_t waitNs, uint64_t holdNs, AbiString modId, AbiString thread) override;
+    void snapshot(LockStats* out) override;
+    void reset() override;
+
+private:
+    std::atomic<bool> m_enabled = false;
+    std::mutex m_mutex;
+    LockStats m_stats;
+
+    LockStatsRecorder() = default;
+};
+
+// Attributes the lock acquisitions of this thread to another mod while alive,
+// used while handling a call that another Argon copy forwarded through the shared token cache
+class LockCallerScope {
+public:
+    explicit LockCallerScope(std::string_view modId);
+    ~LockCallerScope();
+
+    LockCallerScope(const LockCallerScope&) = delete;
+    LockCallerScope& operator=(const LockCallerScope&) = delete;
+
+private:
+    std::string_view m_previous;
+};
+
+// Records how long the lock was held once destroyed, empty if instrumentation was disabled when the lock was taken
+class LockHoldTimer {
+public:
+    LockHoldTimer() = default;
+    LockHoldTimer(SharedLockStatsV1* stats, LockSite site, bool exclusive, bool contended, std::chrono::steady_clock::time_point start);
+    ~LockHoldTimer();
+
+    // Ends the hold, called right before the lock is released so that the unlock itself isn't counted
+    void stop();
+
+    LockHoldTimer(LockHoldTimer&& other) noexcept;
+    LockHoldTimer& operator=(LockHoldTimer&&) = delete;
+
+private:
+    SharedLockStatsV1* m_stats = nullptr;
+    LockSite m_site = LockSite::Other;
+    bool m_exclusive = false;
+    bool m_contended = false;
+    uint64_t m_waitNs = 0;
+    std::chrono::steady_clock::time_point m_acquired;
+    std::chrono::steady_clock::time_point m_released;
+};
+
+}
@@ -2,13 +2,16 @@
 
 #include "ArgonState.hpp"
 #include "ArgonStorage.hpp"
+#include "AuthFlight.hpp"
+#include "Wakeup.hpp"
 #include "Web.hpp"
 
+#include <arc/future/Select.hpp>
+#include <arc/sync/Notify.hpp>
 #include <arc/time/Sleep.hpp>
 #include <asp/time/Duration.hpp>
 #include <Geode/Geode.hpp>
 #include <Geode/utils/terminate.hpp>
-#include <thread>
 
 using namespace geode::prelude;
 using namespace asp::time;
@@ -16,22 +19,12 @@ using namespace arc;
 
 namespace argon {
 
-static std::optional<std::thread::id> g_mainThreadId;
-
-static bool isMainThread() {
-    if (!g_mainThreadId) {
-        // try to be safe and not always return false
-        return geode::utils::thread::getName() == "Main";
-    }
-
-    return std::this_thread::get_id() == *g_mainThreadId;
-}
-
 static void requireMainThread(std::string message) {
-    if (isMainThread()) return;
+    auto& state = ArgonState::get();
+    if (state.isMainThread()) return;
 
     log::warn("Argon - thread safety violation detected");
-    if (!g_mainThreadId) {
+    if (!state.isMainThreadKnown()) {
         log::warn("Load event was never ran - we don't know which thread is main.");
         log::warn("Did you attempt to start authentication before the mod was fully loaded?");
     }
@@ -72,7 +65,7 @@ AccountData getGameAccountData() {
         .userId = userId,
         .username = std::move(username),
         .gjp2 = std::move(gjp),
-        .serverUrl = argon::web::getBaseServerUrl(),
+        .serverUrl = argon::web::refreshBaseServerUrl(),
     };
 }
 
@@ -102,7 +95,7 @@ bool getCertVerification() {
 }
 
 void clearAllTokens() {
-    ArgonStorage::get().clearAllTokens();
+    ArgonStorage::get().clearAllTokens(ArgonState::get().serverUrl());
 }
 
 void clearToken() {
@@ -110,19 +103,93 @@ void clearToken() {
 }
 
 void clearToken(int accountId) {
-    ArgonStorage::get().clearTokens(accountId);
+    ArgonStorage::get().clearTokens(accountId, ArgonState::get().serverUrl());
 }
 
 void clearToken(const AccountData& account) {
     clearToken(account.accountId);
 }
 
+void clearTokens(std::span<const int> accountIds) {
+    ArgonStorage::get().clearTokens(accountIds, ArgonState::get().serverUrl());
+}
+
+void clearTokens(std::span<const AccountData> accounts) {
+    std::vector<int> ids;
+    ids.reserve(accounts.size());
+
+    for (auto& account : accounts) {
+        ids.push_back(account.accountId);
+    }
+
+    clearTokens(ids);
+}
+
+void setStorageBackend(StorageBackend backend) {
+    ArgonStorage::get().setBackend(backend);
+}
+
+void flushTokens() {
+    ArgonStorage::get().flush();
+}
+
+StorageMetrics getStorageMetrics() {
+    return ArgonStorage::get().getMetrics();
+}
+
+void setLockInstrumentation(bool enabled) {
+    auto& argon = ArgonState::get();
+    if (!argon.ensureConfigLock()) {
+        // the statistics only exist once the main thread loaded Argon
+        Loader::get()->queueInMainThread([enabled] { setLockInstrumentation(enabled); });
+        return;
+    }
+
+    argon.lockStats().setEnabled(enabled);
+}
+
+LockStats getLockStats() {
+    LockStats out;
+
+    auto& argon = ArgonState::get();
+    if (argon.ensureConfigLock()) {
+        argon.lockStats().snapshot(&out);
+    }
+
+    return out;
+}
+
+void resetLockStats() {
+    auto& argon = ArgonState::get();
+    if (!argon.ensureConfigLock()) {
+        Loader::get()->queueInMainThread([] { resetLockStats(); });
+        return;
+    }
+
+    argon.lockStats().reset();
+}
+
 bool hasToken() {
     return hasToken(getGameAccountData());
 }
 
 bool hasToken(const AccountData& account) {
-    return ArgonStorage::get().hasAuthToken(account, getServerUrl());
+    return ArgonStorage::get().hasAuthToken(account, ArgonState::get().serverUrl());
+}
+
+std::vector<bool> hasTokens(std::span<const AccountData> accounts) {
+    auto tokens = getTokens(accounts);
+
+    std::vector<bool> out(tokens.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        out[i] = tokens[i].has_value();
+    }
+
+    return out;
+}
+
+std::vector<std::optional<std::string>> getTokens(std::span<const AccountData> accounts) {
+    return ArgonStorage::get().getAuthTokens(accounts, ArgonState::get().serverUrl());
 }
 
 
@@ -130,6 +197,93 @@ AuthFuture startAuth(AccountData data) {
     return startAuth(AuthOptions{ .account = std::move(data) });
 }
 
+static constexpr std::string_view AUTH_CANCELLED = "Authentication was cancelled";
+
+// Resolves once `cancellation` is cancelled, never if it can't be
+static Future<> whenCancelled(CancellationToken cancellation) {
+    // shared with the callback, which can still be running after this future was dropped
+    auto notify = std::make_shared<arc::Notify>();
+    uint64_t callback = cancellation.onCancel([notify] {
+        notify->notifyOne();
+    });
+
+    struct Unregister {
+        const CancellationToken& cancellation;
+        uint64_t callback;
+        ~Unregister() { cancellation.removeCallback(callback); }
+    } unregister{cancellation, callback};
+
+    while (!cancellation.isCancelled()) {
+        co_await notify->notified();
+    }
+}
+
+// Sleeps until `deadline`, waking up early if the attempt gets cancelled. Returns false if it was cancelled
+static Future<bool> sleepUntil(asp::Instant deadline, const CancellationToken& cancellation) {
+    if (cancellation.isCancelled()) {
+        co_return false;
+    }
+
+    if (!cancellation) {
+        co_await arc::sleepUntil(deadline);
+        co_return true;
+    }
+
+    bool slept = false;
+    co_await arc::select(
+        arc::selectee(arc::sleepUntil(deadline), [&] { slept = true; }),
+        arc::selectee(whenCancelled(cancellation), [] {})
+    );
+
+    co_return slept;
+}
+
+// Waits until `wakeup` is woken up or the attempt gets cancelled. Returns false if it was cancelled
+static Future<bool> waitForWakeup(Wakeup& wakeup, const CancellationToken& cancellation) {
+    if (cancellation.isCancelled()) {
+        co_return false;
+    }
+
+    if (!cancellation) {
+        co_await wakeup.wait();
+        co_return true;
+    }
+
+    bool woken = false;
+    co_await arc::select(
+        arc::selectee(wakeup.wait(), [&] { woken = true; }),
+        arc::selectee(whenCancelled(cancellation), [] {})
+    );
+
+    co_return woken;
+}
+
+// Runs a request of the attempt, resolving to an error right away if the attempt gets cancelled.
+// Both race in the same task, so the request is dropped (and aborted) as soon as the cancellation wins
+template <typename T>
+static Future<T> cancellable(const CancellationToken& cancellation, Future<T> request) {
+    // checked first, so that nothing gets sent once cancelled
+    if (cancellation.isCancelled()) {
+        co_return Err(std::string{AUTH_CANCELLED});
+    }
+
+    if (!cancellation) {
+        co_return co_await std::move(request);
+    }
+
+    std::optional<T> result;
+    co_await arc::select(
+        arc::selectee(std::move(request), [&](T value) { result = std::move(value); }),
+        arc::selectee(whenCancelled(cancellation), [] {})
+    );
+
+    if (!result) {
+        co_return Err(std::string{AUTH_CANCELLED});
+    }
+
+    co_return std::move(*result);
+}
+
 inline std::string solveChallenge(int value) {
     return fmt::to_string(value ^ 0x5F3759DF);
 }
@@ -154,55 +308,64 @@ static Future<std::string> troubleshootFailureCause(const AccountData& account,
     co_return "Stage 2 failed due to unknown error, all sanity checks succeeded";
 }
 
-AuthFuture startAuth(AuthOptions options) {
-    if (!options.account.valid()) {
-        co_return Err("Invalid account data");
-    }
-
+static AuthFuture runAuth(const AuthOptions& options, AuthFlight& flight) {
     auto& argon = ArgonState::get();
 
-    // ensure config lock is initialized
-    if (!argon.isConfigLockInitialized()) {
-        co_await geode::async::waitForMainThread([] {
-            ArgonState::get().initConfigLock();
-        });
-    }
-
-    // use cached token if possible
-    if (auto token = ArgonStorage::get().getAuthToken(options.account, argon.getServerUrl())) {
-        log::debug("(Argon) Using cached auth token for account {}", options.account.username);
-        co_return Ok(std::move(*token));
-    }
-
     log::debug(
         "(Argon) Starting authentication for account {} ({}), server: '{}'",
         options.account.username, options.account.accountId, options.account.serverUrl
     );
 
-    auto progress = [&](AuthProgress p) {
-        if (options.progress) options.progress(p);
+    // starts in the queued stage
+    AuthStageClock clock{flight};
+    auto& cancellation = options.cancellation;
+
+    // wait for our turn, other attempts could be sending messages from the same account or flooding the server.
+    // declared first so that it outlives the slot
+    Wakeup granted;
+    AuthSlot slot{
+        &argon.authScheduler(), argon.serverUrl(), options.account.accountId,
+        static_cast<int32_t>(options.priority), granted.waker()
     };
 
-    progress(AuthProgress::RequestedChallenge);
-    ARC_CO_UNWRAP_INTO(auto s1data, co_await web::startChallenge(options.account, "message", options.forceStrong));
+    while (!slot.acquired()) {
+        if (!co_await waitForWakeup(granted, cancellation)) {
+            co_return Err(std::string{AUTH_CANCELLED});
+        }
+    }
+
+    clock.enter(&AuthTimings::challengeStart, AuthProgress::RequestedChallenge);
+    ARC_CO_UNWRAP_INTO(auto s1data, co_await cancellable(cancellation, web::startChallenge(options.account, "message", options.forceStrong)));
 
     // TODO: in future try falling back to comment auth
 
-    progress(AuthProgress::SolvingChallenge);
+    clock.enter(&AuthTimings::solutionSubmit, AuthProgress::SolvingChallenge);
     auto solution = solveChallenge(s1data.challenge);
-    auto s2res = co_await submitSolution(options.account, solution, s1data.id);
+    auto s2res = co_await cancellable(cancellation, submitSolution(options.account, solution, s1data.id));
     if (!s2res) {
+        // no point in finding out what went wrong if nobody is waiting for the answer
+        if (cancellation.isCancelled()) {
+            co_return Err(std::string{AUTH_CANCELLED});
+        }
+
         co_return Err(co_await troubleshootFailureCause(options.account, s1data.id));
     }
 
-    progress(AuthProgress::VerifyingChallenge);
-    ARC_CO_UNWRAP_INTO(auto vdata, co_await web::verifyChallenge(options.account, s1data.challengeId, solution));
+    // the message is sent, the next attempt can start while we wait for the server to verify it
+    slot.release();
+
+    clock.enter(&AuthTimings::firstVerify, AuthProgress::VerifyingChallenge);
+    ARC_CO_UNWRAP_INTO(auto vdata, co_await cancellable(cancellation, web::verifyChallenge(options.account, s1data.challengeId, solution)));
 
     auto startedAt = asp::Instant::now();
     auto latestDeadline = startedAt + asp::Duration::fromSecs(30);
 
     while (std::holds_alternative<web::PollLater>(vdata)) {
         auto& plater = std::get<web::PollLater>(vdata);
+
+        // the first round ends the first verification, every next one ends the previous round
+        clock.enter(&AuthTimings::polling, AuthProgress::VerifyingChallenge, plater.ms);
+
         auto waitTime = asp::Duration::fromMillis(plater.ms);
         auto now = asp::Instant::now();
 
@@ -213,7 +376,9 @@ AuthFuture startAuth(AuthOptions options) {
         );
 
         log::debug("(Argon) Waiting for {} and polling again..", waitTime.toString());
-        co_await arc::sleepUntil(deadline);
+        if (!co_await sleepUntil(deadline, cancellation)) {
+            co_return Err(std::string{AUTH_CANCELLED});
+        }
 
         now = asp::Instant::now();
         if (now >= latestDeadline) {
@@ -221,7 +386,8 @@ AuthFuture startAuth(AuthOptions options) {
         }
 
         // poll again
-        ARC_CO_UNWRAP_INTO(vdata, co_await web::verifyChallengePoll(options.account, s1data.challengeId, solution));
+        ARC_CO_UNWRAP_INTO(vdata, co_await cancellable(cancellation, web::verifyChallengePoll(options.account, s1data.challengeId, solution)));
+        clock.countPoll();
     }
 
     auto& verif = std::get<web::SuccessfulVerification>(vdata);
@@ -230,20 +396,175 @@ AuthFuture startAuth(AuthOptions options) {
     co_return Ok(std::move(verif.authtoken));
 }
 
+// Runs the attempt unless another Argon copy is already authenticating this account, in which case its result is used
+static AuthFuture runSharedAuth(const AuthOptions& options, AuthFlight& flight, const AuthKey& key) {
+    auto& registry = ArgonState::get().authRegistry();
+
+    while (true) {
+        // woken up once another copy's attempt ends
+        Wakeup ended;
+
+        uint64_t ticket;
+        if (registry.tryBegin(key.serverUrl, key.accountId, key.userId, &ticket, ended.waker())) {
+            SharedAuthClaim claim{&registry, ticket};
+
+            // an attempt that ended since the caller last looked (in this mod, or in another one that we waited for
+            // before taking over) could have stored the token already
+            if (auto token = ArgonStorage::get().getAuthToken(options.account, key.serverUrl)) {
+                flight.setTimings(AuthTimings{ .cached = true });
+
+                AuthResult result = Ok(std::move(*token));
+                claim.finish(result);
+                co_return result;
+            }
+
+            auto result = co_await runAuth(options, flight);
+
+            // a cancelled attempt is abandoned rather than failed, so that waiting copies run their own
+            if (result || !options.cancellation.isCancelled()) {
+                claim.finish(result);
+            }
+
+            co_return result;
+        }
+
+        log::debug("(Argon) Waiting for authentication started by another mod for account {}", options.account.username);
+
+        std::string error;
+        auto outcome = SharedAuthOutcome::Running;
+        {
+            SharedAuthWait wait{&registry, ticket, ended.waker()};
+
+            while ((outcome = registry.outcome(ticket, &error, &writeToStdString)) == SharedAuthOutcome::Running) {
+                if (!co_await waitForWakeup(ended, options.cancellation)) {
+                    co_return Err(std::string{AUTH_CANCELLED});
+                }
+            }
+        }
+
+        // nothing ran in this mod, unless the attempt was abandoned and we end up running our own
+        flight.setTimings(AuthTimings{ .shared = true });
+
+        if (outcome == SharedAuthOutcome::Failed) {
+            co_return Err(std::move(error));
+        }
+
+        // the other copy stored the token in the shared storage
+        if (outcome == SharedAuthOutcome::Succeeded) {
+            if (auto token = ArgonStorage::get().getAuthToken(options.account, key.serverUrl)) {
+                co_return Ok(std::move(*token));
+            }
+        }
+
+        // the attempt was abandoned, or the token was issued for a different username, try again
+    }
+}
+
+// `options` is owned by the `startAuth` call, the progress listeners keep pointers to its callbacks
+static AuthFuture authenticate(AuthOptions& options, AuthTimings& timings) {
+    if (!options.account.valid()) {
+        co_return Err("Invalid account data");
+    }
+
+    auto& argon = ArgonState::get();
+
+    // the config lock is normally initialized at load. if a mod starts authenticating before that,
+    // the main thread has to do it, this task waits for it without blocking the thread
+    if (!argon.ensureConfigLock()) {
+        co_await geode::async::waitForMainThread([] {
+            ArgonState::get().initConfigLock();
+        });
+    }
+
+    // use cached token if possible
+    if (auto token = ArgonStorage::get().getAuthToken(options.account, argon.serverUrl())) {
+        log::debug("(Argon) Using cached auth token for account {}", options.account.username);
+        timings.cached = true;
+        co_return Ok(std::move(*token));
+    }
+
+    AuthKey key{std::string{argon.serverUrl()}, options.account.accountId, options.account.userId};
+
+    while (true) {
+        bool leader;
+        auto flight = AuthFlights::get().join(key, leader);
+        // woken up once the flight finishes, declared first so that it outlives the listener
+        Wakeup finished;
+        AuthFlight::Listener listener{flight, &options.progress, &options.progressEvent, &finished};
+
+        if (leader) {
+            AuthLeader lead{key, flight};
+
+            auto result = co_await runSharedAuth(options, *flight, key);
+            timings = flight->timings();
+
+            // same as above, other calls waiting for this attempt start their own
+            if (result || !options.cancellation.isCancelled()) {
+                lead.finish(result);
+            }
+
+            co_return result;
+        }
+
+        // someone else is already authenticating this account, wait for them instead of sending another message
+        log::debug("(Argon) Waiting for authentication already in progress for account {}", options.account.username);
+
+        while (!flight->finished()) {
+            if (!co_await waitForWakeup(finished, options.cancellation)) {
+                co_return Err(std::string{AUTH_CANCELLED});
+            }
+        }
+
+        if (auto& result = flight->result()) {
+            timings = flight->timings();
+            timings.shared = true;
+            co_return *result;
+        }
+
+        // the attempt was abandoned, try again and possibly run it ourselves
+    }
+}
+
+AuthFuture startAuth(AuthOptions options) {
+    auto startedAt = std::chrono::steady_clock::now();
+
+    AuthTimings timings;
+    auto result = co_await authenticate(options, timings);
+
+    if (options.timings) {
+        timings.total = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startedAt);
+        options.timings(timings);
+    }
+
+    co_return result;
+}
+
 $execute {
     ModStateEvent(ModEventType::Loaded, Mod::get()).listen([] {
         // set the entry thread as main for now, if a mod decides to use argon in $on_mod
-        g_mainThreadId = std::this_thread::get_id();
+        ArgonState::get().setMainThread();
         Loader::get()->queueInMainThread([] {
             // once we have main thread, actually set it
-            g_mainThreadId = std::this_thread::get_id();
+            ArgonState::get().setMainThread();
             Loader::get()->queueInMainThread([] {
                 // on macos, two queues are needed to get to the *real* director thread :)
-                g_mainThreadId = std::this_thread::get_id();
+                ArgonState::get().setMainThread();
                 ArgonState::get().initConfigLock();
+                argon::web::refreshBaseServerUrl();
+
+                // load the tokens in the background, so the first auth call finds them in memory
+                ArgonStorage::get().prewarm(
+                    signedIn() ? std::optional{getGameAccountData()} : std::nullopt,
+                    getServerUrl()
+                );
             });
         });
     }, -10000).leak();
+
+    ModStateEvent(ModEventType::DataSaved, Mod::get()).listen([] {
+        // make sure no token changes are lost when the game closes
+        ArgonStorage::get().flush();
+    }).leak();
 }
 
 }
@@ -0,0 +1,127 @@
+#include "MappedFile.hpp"
+
+#include <Geode/platform/cplatform.h>
+#include <utility>
+
+#ifdef GEODE_IS_WINDOWS
+# include <Windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+using geode::Ok;
+using geode::Err;
+
+namespace argon {
+
+#ifdef GEODE_IS_WINDOWS
+
+geode::Result<MappedFile> MappedFile::open(const std::filesystem::path& path) {
+    // allow other mods to replace the file while we have it mapped
+    HANDLE file = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return Err("failed to open file (error {})", GetLastError());
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return Err("file is empty or could not be read");
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (!mapping) {
+        return Err("failed to create file mapping (error {})", GetLastError());
+    }
+
+    // the view keeps the mapping alive
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!data) {
+        return Err("failed to map file (error {})", GetLastError());
+    }
+
+    MappedFile out;
+    out.m_data = static_cast<const uint8_t*>(data);
+    out.m_size = static_cast<size_t>(size.QuadPart);
+    return Ok(std::move(out));
+}
+
+void MappedFile::unmap() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+}
+
+#else
+
+geode::Result<MappedFile> MappedFile::open(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return Err("failed to open file (errno {})", errno);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return Err("file is empty or could not be read");
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        return Err("failed to map file (errno {})", errno);
+    }
+
+    MappedFile out;
+    out.m_data = static_cast<const uint8_t*>(data);
+    out.m_size = static_cast<size_t>(st.st_size);
+    return Ok(std::move(out));
+}
+
+void MappedFile::unmap() {
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    this->unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        this->unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+
+    return *this;
+}
+
+const uint8_t* MappedFile::data() const {
+    return m_data;
+}
+
+size_t MappedFile::size() const {
+    return m_size;
+}
+
+}
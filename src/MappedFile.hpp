@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Geode/Result.hpp>
+#include <filesystem>
+#include <stdint.h>
+
+namespace argon {
+
+// Read-only memory mapping of an entire file
+class MappedFile {
+public:
+    static geode::Result<MappedFile> open(const std::filesystem::path& path);
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const uint8_t* data() const;
+    size_t size() const;
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+
+    void unmap();
+};
+
+}
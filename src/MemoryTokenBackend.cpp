@@ -0,0 +1,92 @@
+#include "MemoryTokenBackend.hpp"
+
+#include <chrono>
+#include <mutex>
+
+using geode::Ok;
+
+namespace argon {
+
+static int64_t unixNow() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::optional<std::string> MemoryTokenBackend::get(TokenKeyView key, std::string_view username) {
+    std::shared_lock lock(m_mutex);
+
+    auto token = m_index.find(key);
+    if (!token || token->name != username) {
+        return std::nullopt;
+    }
+
+    return token->token;
+}
+
+std::vector<std::optional<std::string>> MemoryTokenBackend::getMany(std::span<const TokenQuery> queries) {
+    std::shared_lock lock(m_mutex);
+
+    std::vector<std::optional<std::string>> out(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto token = m_index.find(queries[i].key);
+        if (token && token->name == queries[i].username) {
+            out[i] = token->token;
+        }
+    }
+
+    return out;
+}
+
+geode::Result<> MemoryTokenBackend::upsert(TokenKeyView key, std::string_view username, std::string_view serverIdent, std::string_view authtoken) {
+    std::unique_lock lock(m_mutex);
+
+    int64_t now = unixNow();
+    m_index.upsert(StoredToken {
+        .url = std::string{key.url},
+        .accountId = key.accountId,
+        .userId = key.userId,
+        .name = std::string{username},
+        .ident = std::string{serverIdent},
+        .token = std::string{authtoken},
+        .createdAt = now,
+        .lastUsedAt = now,
+    });
+
+    m_generation++;
+    m_mutations++;
+
+    return Ok();
+}
+
+void MemoryTokenBackend::eraseAccounts(std::string_view url, std::span<const int> accountIds) {
+    std::unique_lock lock(m_mutex);
+
+    for (int accountId : accountIds) {
+        if (m_index.eraseAccount(url, accountId) != 0) {
+            m_generation++;
+            m_mutations++;
+        }
+    }
+}
+
+void MemoryTokenBackend::eraseServer(std::string_view url) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_index.eraseServer(url) != 0) {
+        m_generation++;
+        m_mutations++;
+    }
+}
+
+uint64_t MemoryTokenBackend::generation() {
+    std::shared_lock lock(m_mutex);
+    return m_generation;
+}
+
+void MemoryTokenBackend::flush() {}
+
+StorageMetrics MemoryTokenBackend::metrics() {
+    std::shared_lock lock(m_mutex);
+    return StorageMetrics { .mutations = m_mutations };
+}
+
+}
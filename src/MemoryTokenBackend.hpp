@@ -0,0 +1,30 @@
+#pragma once
+#include "TokenBackend.hpp"
+
+#include <shared_mutex>
+
+namespace argon {
+
+// Token storage that lives only in memory, nothing is read from or written to disk
+class MemoryTokenBackend : public TokenBackend {
+public:
+    std::optional<std::string> get(TokenKeyView key, std::string_view username) override;
+    std::vector<std::optional<std::string>> getMany(std::span<const TokenQuery> queries) override;
+    geode::Result<> upsert(TokenKeyView key, std::string_view username, std::string_view serverIdent, std::string_view authtoken) override;
+    void eraseAccounts(std::string_view url, std::span<const int> accountIds) override;
+    void eraseServer(std::string_view url) override;
+
+    uint64_t generation() override;
+    // tokens are never dropped
+    void requestMaxTokens(size_t count) override {}
+    void flush() override;
+    StorageMetrics metrics() override;
+
+private:
+    std::shared_mutex m_mutex;
+    TokenIndex m_index;
+    uint64_t m_generation = 0;
+    uint64_t m_mutations = 0;
+};
+
+}
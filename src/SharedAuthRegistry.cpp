@@ -0,0 +1,111 @@
+#include "SharedAuthRegistry.hpp"
+
+namespace argon {
+
+AuthRegistry* AuthRegistry::create() {
+    auto ret = new AuthRegistry();
+    ret->autorelease();
+    return ret;
+}
+
+bool AuthRegistry::tryBegin(AbiString url, int accountId, int userId, uint64_t* ticket, AbiWaker waker) {
+    std::lock_guard lock(m_mutex);
+
+    AuthKey key{std::string{url}, accountId, userId};
+
+    auto [it, inserted] = m_running.try_emplace(key, m_nextTicket);
+    if (inserted) {
+        m_attempts.emplace(m_nextTicket, Attempt{.key = std::move(key)});
+        m_nextTicket++;
+    } else {
+        m_attempts.at(it->second).waiters.push_back(waker);
+    }
+
+    *ticket = it->second;
+    return inserted;
+}
+
+void AuthRegistry::stopWaiting(uint64_t ticket, AbiWaker waker) {
+    std::lock_guard lock(m_mutex);
+
+    auto it = m_attempts.find(ticket);
+    if (it == m_attempts.end()) {
+        return;
+    }
+
+    std::erase_if(it->second.waiters, [&](const AbiWaker& w) {
+        return w.wake == waker.wake && w.ctx == waker.ctx;
+    });
+}
+
+void AuthRegistry::end(uint64_t ticket, SharedAuthOutcome outcome, AbiString error) {
+    std::lock_guard lock(m_mutex);
+
+    auto it = m_attempts.find(ticket);
+    if (it == m_attempts.end() || it->second.outcome != SharedAuthOutcome::Running) {
+        return;
+    }
+
+    auto& attempt = it->second;
+    attempt.outcome = outcome;
+    if (outcome == SharedAuthOutcome::Failed) {
+        attempt.error = std::string{error};
+    }
+
+    m_running.erase(attempt.key);
+
+    // under the lock, so that a waiter can't go away while being woken up
+    for (auto& waker : attempt.waiters) {
+        waker();
+    }
+    attempt.waiters.clear();
+
+    m_ended.push_back(ticket);
+    if (m_ended.size() > MAX_ENDED) {
+        m_attempts.erase(m_ended.front());
+        m_ended.pop_front();
+    }
+}
+
+SharedAuthOutcome AuthRegistry::outcome(uint64_t ticket, void* err, AbiStringSink sink) {
+    std::lock_guard lock(m_mutex);
+
+    auto it = m_attempts.find(ticket);
+    if (it == m_attempts.end()) {
+        return SharedAuthOutcome::Abandoned;
+    }
+
+    if (it->second.outcome == SharedAuthOutcome::Failed) {
+        sink(err, it->second.error);
+    }
+
+    return it->second.outcome;
+}
+
+SharedAuthWait::SharedAuthWait(SharedAuthRegistryV1* registry, uint64_t ticket, AbiWaker waker)
+    : m_registry(registry), m_ticket(ticket), m_waker(waker) {}
+
+SharedAuthWait::~SharedAuthWait() {
+    m_registry->stopWaiting(m_ticket, m_waker);
+}
+
+SharedAuthClaim::SharedAuthClaim(SharedAuthRegistryV1* registry, uint64_t ticket)
+    : m_registry(registry), m_ticket(ticket) {}
+
+SharedAuthClaim::~SharedAuthClaim() {
+    if (!m_finished) {
+        m_registry->end(m_ticket, SharedAuthOutcome::Abandoned, std::string_view{});
+    }
+}
+
+void SharedAuthClaim::finish(AuthResult result) {
+    m_finished = true;
+
+    if (result) {
+        m_registry->end(m_ticket, SharedAuthOutcome::Succeeded, std::string_view{});
+    } else {
+        m_registry->end(m_ticket, SharedAuthOutcome::Failed, result.unwrapErr());
+    }
+}
+
+}
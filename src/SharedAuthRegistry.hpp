@@ -0,0 +1,104 @@
+#pragma once
+#include "AuthFlight.hpp"
+#include "SharedTokenCache.hpp"
+
+#include <cocos2d.h>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace argon {
+
+enum class SharedAuthOutcome : int32_t {
+    Running = 0,
+    // the token was stored, waiters should read it from the storage
+    Succeeded = 1,
+    Failed = 2,
+    // the attempt was dropped before it finished, waiters should start their own
+    Abandoned = 3,
+};
+
+// Authentication attempts running in any Argon copy in the process, published through a GameManager user object
+// like the config lock. Lets a copy that is about to start a challenge wait for another copy's attempt instead.
+//
+// This is an ABI boundary, the same rules as for `SharedTokenCacheV1` apply.
+class SharedAuthRegistryV1 : public cocos2d::CCObject {
+public:
+    // Starts an attempt for this account unless one is already running, returns true if the caller now has to run it.
+    // Either way `ticket` is set to the ID of the attempt. If one was already running, `waker` is called once it ends,
+    // until it's removed with `stopWaiting`. Wakers are called under the registry lock
+    virtual bool tryBegin(AbiString url, int accountId, int userId, uint64_t* ticket, AbiWaker waker) = 0;
+    // Forgets the waker passed to `tryBegin`, it's not called anymore once this returns. Fine to call after the attempt ended
+    virtual void stopWaiting(uint64_t ticket, AbiWaker waker) = 0;
+    // Ends an attempt started with `tryBegin`, `error` is only used for `SharedAuthOutcome::Failed`
+    virtual void end(uint64_t ticket, SharedAuthOutcome outcome, AbiString error) = 0;
+    // Returns the state of the attempt, and passes the error to `sink` if it failed.
+    // Attempts that ended a long time ago are reported as abandoned
+    virtual SharedAuthOutcome outcome(uint64_t ticket, void* err, AbiStringSink sink) = 0;
+};
+
+class AuthRegistry : public SharedAuthRegistryV1 {
+public:
+    static AuthRegistry* create();
+
+    bool tryBegin(AbiString url, int accountId, int userId, uint64_t* ticket, AbiWaker waker) override;
+    void stopWaiting(uint64_t ticket, AbiWaker waker) override;
+    void end(uint64_t ticket, SharedAuthOutcome outcome, AbiString error) override;
+    SharedAuthOutcome outcome(uint64_t ticket, void* err, AbiStringSink sink) override;
+
+private:
+    // how many ended attempts are remembered, waiters only need them for a moment
+    static constexpr size_t MAX_ENDED = 64;
+
+    struct Attempt {
+        AuthKey key;
+        SharedAuthOutcome outcome = SharedAuthOutcome::Running;
+        std::string error;
+        // copies waiting for the attempt to end
+        std::vector<AbiWaker> waiters;
+    };
+
+    std::mutex m_mutex;
+    uint64_t m_nextTicket = 1;
+    std::unordered_map<AuthKey, uint64_t, AuthKeyHash> m_running;
+    std::unordered_map<uint64_t, Attempt> m_attempts;
+    std::deque<uint64_t> m_ended;
+
+    AuthRegistry() = default;
+};
+
+// Held by a copy waiting for another copy's attempt, stops waiting if destroyed
+class SharedAuthWait {
+public:
+    SharedAuthWait(SharedAuthRegistryV1* registry, uint64_t ticket, AbiWaker waker);
+    ~SharedAuthWait();
+
+    SharedAuthWait(const SharedAuthWait&) = delete;
+    SharedAuthWait& operator=(const SharedAuthWait&) = delete;
+
+private:
+    SharedAuthRegistryV1* m_registry;
+    uint64_t m_ticket;
+    AbiWaker m_waker;
+};
+
+// Held by the copy that runs an attempt, abandons it if destroyed without ending it
+class SharedAuthClaim {
+public:
+    SharedAuthClaim(SharedAuthRegistryV1* registry, uint64_t ticket);
+    ~SharedAuthClaim();
+
+    SharedAuthClaim(const SharedAuthClaim&) = delete;
+    SharedAuthClaim& operator=(const SharedAuthClaim&) = delete;
+
+    void finish(AuthResult result);
+
+private:
+    SharedAuthRegistryV1* m_registry;
+    uint64_t m_ticket;
+    bool m_finished = false;
+};
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <argon/argon.hpp>
+#include <cocos2d.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+namespace argon {
+
+// Plain string view that can be passed between Argon copies built with different standard libraries
+struct AbiString {
+    const char* data;
+    size_t size;
+
+    AbiString(std::string_view str) : data(str.data()), size(str.size()) {}
+    AbiString(const std::string& str) : data(str.data()), size(str.size()) {}
+
+    operator std::string_view() const {
+        return { data, size };
+    }
+};
+
+// Receives a string from the other side, `out` is owned by the caller
+using AbiStringSink = void(*)(void* out, AbiString str);
+
+inline void writeToStdString(void* out, AbiString str) {
+    static_cast<std::string*>(out)->assign(str.data, str.size);
+}
+
+// Receives the string at `index` of a batch, `out` is owned by the caller
+using AbiIndexedStringSink = void(*)(void* out, size_t index, AbiString str);
+
+inline void writeToOptionalStringVec(void* out, size_t index, AbiString str) {
+    (*static_cast<std::vector<std::optional<std::string>>*>(out))[index].emplace(str.data, str.size);
+}
+
+// Wakes up a task of the Argon copy that passed it, see `Wakeup`. Cheap and never blocks
+struct AbiWaker {
+    void (*wake)(void* ctx);
+    void* ctx;
+
+    void operator()() const {
+        wake(ctx);
+    }
+};
+
+struct AbiTokenQuery {
+    AbiString url;
+    int accountId;
+    int userId;
+    AbiString username;
+};
+
+// Token cache shared by every Argon copy in the process (each mod links its own static copy of Argon).
+// The first copy to load publishes its storage through a GameManager user object, and the others forward all calls to it,
+// so the storage is parsed once and a token stored by one mod is immediately visible to all of them.
+//
+// This is an ABI boundary: the layout must never change. Breaking changes need a new class and a new user object key,
+// copies that only know the old version will keep using it alongside.
+//
+// Every call takes the ID of the calling mod, so that config lock statistics are attributed to it rather than to the publisher.
+class SharedTokenCacheV1 : public cocos2d::CCObject {
+public:
+    virtual bool getToken(AbiString modId, AbiString url, int accountId, int userId, AbiString username, void* out, AbiStringSink sink) = 0;
+    // Returns false and writes the error message into `err` on failure
+    virtual bool storeToken(AbiString modId, AbiString url, int accountId, int userId, AbiString username, AbiString ident, AbiString token, void* err, AbiStringSink errSink) = 0;
+    // Clears the tokens of these accounts / all tokens issued by the server at `url`
+    virtual void clearTokens(AbiString modId, AbiString url, const int* accountIds, size_t count) = 0;
+    virtual void clearAllTokens(AbiString modId, AbiString url) = 0;
+    // Blocks until all pending changes are written to disk
+    virtual void flush(AbiString modId) = 0;
+    virtual void getMetrics(AbiString modId, StorageMetrics* out) = 0;
+
+    // Batched `getToken`, handled under a single lock.
+    // The token of every query that has one is passed to `sink` along with the index of the query
+    virtual void getTokens(AbiString modId, const AbiTokenQuery* queries, size_t count, void* out, AbiIndexedStringSink sink) = 0;
+    // Changes every time the stored tokens change
+    virtual uint64_t generation(AbiString modId) = 0;
+    // Asks the storage to keep at least `count` tokens, the largest limit asked for by any copy wins
+    virtual void requestMaxTokens(AbiString modId, size_t count) = 0;
+};
+
+}
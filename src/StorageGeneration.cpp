@@ -0,0 +1,19 @@
+#include "StorageGeneration.hpp"
+
+namespace argon {
+
+StorageGeneration* StorageGeneration::create() {
+    auto ret = new StorageGeneration();
+    ret->autorelease();
+    return ret;
+}
+
+uint64_t StorageGeneration::load() {
+    return m_value.load(std::memory_order::acquire);
+}
+
+void StorageGeneration::bump() {
+    m_value.fetch_add(1, std::memory_order::release);
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "SharedTokenCache.hpp"
+
+#include <cocos2d.h>
+#include <atomic>
+#include <stdint.h>
+
+namespace argon {
+
+// Counter bumped by every Argon copy in the process whenever it writes the token storage, published through
+// a GameManager user object like the config lock. Lets lock-free lookups tell whether the files could have changed
+// without looking at them. Older Argon versions don't know about it.
+//
+// This is an ABI boundary, the same rules as for `SharedTokenCacheV1` apply.
+class SharedStorageGenerationV1 : public cocos2d::CCObject {
+public:
+    virtual uint64_t load() = 0;
+    // Config lock must be held
+    virtual void bump() = 0;
+};
+
+class StorageGeneration : public SharedStorageGenerationV1 {
+public:
+    static StorageGeneration* create();
+
+    uint64_t load() override;
+    void bump() override;
+
+private:
+    // never 0, filters that were never built are tagged with 0
+    std::atomic<uint64_t> m_value = 1;
+
+    StorageGeneration() = default;
+};
+
+}
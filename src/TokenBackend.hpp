@@ -0,0 +1,50 @@
+#pragma once
+#include "TokenIndex.hpp"
+
+#include <Geode/Result.hpp>
+#include <argon/argon.hpp>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace argon {
+
+struct TokenQuery {
+    TokenKeyView key;
+    std::string_view username;
+};
+
+// Storage of authtokens, keyed on (server url, account ID, user ID). All methods are thread-safe.
+// Tokens of different servers are independent of each other, nothing ever affects more than one server.
+//
+// `FileTokenBackend` is the real storage shared with other mods through the save directory,
+// `MemoryTokenBackend` keeps everything in memory and is meant for tests and benchmarks.
+class TokenBackend {
+public:
+    virtual ~TokenBackend() = default;
+
+    // Returns the token with this key, unless it was issued under a different username
+    virtual std::optional<std::string> get(TokenKeyView key, std::string_view username) = 0;
+    // Batched `get`, the result has one entry per query
+    virtual std::vector<std::optional<std::string>> getMany(std::span<const TokenQuery> queries) = 0;
+    // Inserts the token, or replaces the one with the same key
+    virtual geode::Result<> upsert(TokenKeyView key, std::string_view username, std::string_view serverIdent, std::string_view authtoken) = 0;
+    // Erases the tokens of these accounts that were issued by this server
+    virtual void eraseAccounts(std::string_view url, std::span<const int> accountIds) = 0;
+    // Erases all tokens issued by this server
+    virtual void eraseServer(std::string_view url) = 0;
+
+    // Changes every time the stored tokens change
+    virtual uint64_t generation() = 0;
+    // Asks the backend to keep at least this many tokens before dropping the least recently used ones.
+    // Every Argon copy using the backend asks for its own limit, the largest one wins
+    virtual void requestMaxTokens(size_t count) = 0;
+    // Blocks until all changes are persisted, if the backend persists anything
+    virtual void flush() = 0;
+    virtual StorageMetrics metrics() = 0;
+    // Loads the tokens ahead of time, so that the next calls don't have to wait for the disk. Blocks until done
+    virtual void prewarm() {}
+};
+
+}
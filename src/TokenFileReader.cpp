@@ -0,0 +1,357 @@
+#include "TokenFileReader.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+using geode::Ok;
+using geode::Err;
+
+namespace argon {
+
+TokenFileReader::TokenFileReader(std::string_view data) : m_data(data) {}
+
+uint64_t TokenFileReader::version() const {
+    return m_version;
+}
+
+void TokenFileReader::skipWhitespace() {
+    while (m_pos < m_data.size()) {
+        char c = m_data[m_pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        m_pos++;
+    }
+}
+
+bool TokenFileReader::consume(char c) {
+    this->skipWhitespace();
+    if (m_pos < m_data.size() && m_data[m_pos] == c) {
+        m_pos++;
+        return true;
+    }
+
+    return false;
+}
+
+geode::Result<> TokenFileReader::expect(char c) {
+    if (!this->consume(c)) {
+        return Err("expected '{}' at offset {}", c, m_pos);
+    }
+
+    return Ok();
+}
+
+static void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else {
+        out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    }
+}
+
+static bool readHex4(std::string_view data, size_t pos, uint32_t& out) {
+    if (data.size() - pos < 4) return false;
+
+    auto [ptr, ec] = std::from_chars(data.data() + pos, data.data() + pos + 4, out, 16);
+    return ec == std::errc{} && ptr == data.data() + pos + 4;
+}
+
+geode::Result<> TokenFileReader::readString(std::string& out) {
+    GEODE_UNWRAP(this->expect('"'));
+    out.clear();
+
+    while (m_pos < m_data.size()) {
+        // copy everything up to the next quote or escape in one go
+        size_t end = m_data.find_first_of("\"\\", m_pos);
+        if (end == std::string_view::npos) break;
+
+        out.append(m_data.data() + m_pos, end - m_pos);
+        m_pos = end + 1;
+
+        if (m_data[end] == '"') {
+            return Ok();
+        }
+
+        if (m_pos >= m_data.size()) break;
+        char esc = m_data[m_pos++];
+
+        switch (esc) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t cp;
+                if (!readHex4(m_data, m_pos, cp)) {
+                    return Err("invalid unicode escape at offset {}", m_pos);
+                }
+                m_pos += 4;
+
+                // surrogate pair
+                uint32_t low;
+                if (
+                    cp >= 0xd800 && cp < 0xdc00
+                    && m_data.substr(m_pos, 2) == "\\u"
+                    && readHex4(m_data, m_pos + 2, low)
+                    && low >= 0xdc00 && low < 0xe000
+                ) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    m_pos += 6;
+                }
+
+                appendUtf8(out, cp);
+                break;
+            }
+            default:
+                return Err("invalid escape sequence at offset {}", m_pos);
+        }
+    }
+
+    return Err("unterminated string");
+}
+
+geode::Result<> TokenFileReader::skipString() {
+    GEODE_UNWRAP(this->expect('"'));
+
+    while (m_pos < m_data.size()) {
+        size_t end = m_data.find_first_of("\"\\", m_pos);
+        if (end == std::string_view::npos) break;
+
+        if (m_data[end] == '"') {
+            m_pos = end + 1;
+            return Ok();
+        }
+
+        // skip the escaped character
+        m_pos = end + 2;
+    }
+
+    return Err("unterminated string");
+}
+
+geode::Result<int64_t> TokenFileReader::readInt(bool& ok) {
+    this->skipWhitespace();
+
+    int64_t out = 0;
+    auto begin = m_data.data() + m_pos;
+    auto [ptr, ec] = std::from_chars(begin, m_data.data() + m_data.size(), out);
+
+    // anything else (including fractions, exponents, strings) is skipped and treated as missing
+    ok = ec == std::errc{} && ptr != begin;
+    if (ok && ptr < m_data.data() + m_data.size()) {
+        char c = *ptr;
+        ok = c != '.' && c != 'e' && c != 'E';
+    }
+
+    if (!ok) {
+        GEODE_UNWRAP(this->skipValue());
+        return Ok(0);
+    }
+
+    m_pos = ptr - m_data.data();
+    return Ok(out);
+}
+
+geode::Result<> TokenFileReader::skipValue() {
+    size_t depth = 0;
+
+    do {
+        this->skipWhitespace();
+        if (m_pos >= m_data.size()) {
+            return Err("unexpected end of file");
+        }
+
+        char c = m_data[m_pos];
+        switch (c) {
+            case '"':
+                GEODE_UNWRAP(this->skipString());
+                break;
+            case '{': case '[':
+                depth++;
+                m_pos++;
+                break;
+            case '}': case ']':
+                if (depth == 0) return Err("unexpected '{}' at offset {}", c, m_pos);
+                depth--;
+                m_pos++;
+                break;
+            case ',': case ':':
+                if (depth == 0) return Err("unexpected '{}' at offset {}", c, m_pos);
+                m_pos++;
+                break;
+            default: {
+                // number, true, false or null
+                size_t start = m_pos;
+                m_pos = std::min(m_data.find_first_of(",:[]{}\" \t\n\r", m_pos), m_data.size());
+
+                if (m_pos == start) return Err("unexpected character at offset {}", m_pos);
+                break;
+            }
+        }
+    } while (depth > 0);
+
+    return Ok();
+}
+
+geode::Result<> TokenFileReader::readEntry(StoredToken& out) {
+    out.url.clear();
+    out.name.clear();
+    out.ident.clear();
+    out.token.clear();
+    out.accountId = 0;
+    out.userId = 0;
+    out.createdAt = 0;
+    out.lastUsedAt = 0;
+
+    GEODE_UNWRAP(this->expect('{'));
+    if (this->consume('}')) {
+        return Ok();
+    }
+
+    do {
+        GEODE_UNWRAP(this->readString(m_key));
+        GEODE_UNWRAP(this->expect(':'));
+        this->skipWhitespace();
+
+        std::string* str = nullptr;
+        if (m_key == "url") str = &out.url;
+        else if (m_key == "name") str = &out.name;
+        else if (m_key == "ident") str = &out.ident;
+        else if (m_key == "token") str = &out.token;
+
+        bool ok = true;
+        if (str && m_pos < m_data.size() && m_data[m_pos] == '"') {
+            GEODE_UNWRAP(this->readString(*str));
+        } else if (m_key == "accid") {
+            GEODE_UNWRAP_INTO(auto v, this->readInt(ok));
+            out.accountId = static_cast<int>(v);
+        } else if (m_key == "userid") {
+            GEODE_UNWRAP_INTO(auto v, this->readInt(ok));
+            out.userId = static_cast<int>(v);
+        } else if (m_key == "created") {
+            GEODE_UNWRAP_INTO(out.createdAt, this->readInt(ok));
+        } else if (m_key == "lastUsed") {
+            GEODE_UNWRAP_INTO(out.lastUsedAt, this->readInt(ok));
+        } else {
+            // unknown field, or a field with the wrong type, which is treated as missing
+            GEODE_UNWRAP(this->skipValue());
+        }
+    } while (this->consume(','));
+
+    return this->expect('}');
+}
+
+geode::Result<bool> TokenFileReader::next(StoredToken& out) {
+    while (true) {
+        switch (m_state) {
+            case State::Start: {
+                GEODE_UNWRAP(this->expect('{'));
+                m_state = State::Root;
+                m_first = true;
+                break;
+            }
+
+            case State::Root: {
+                if (this->consume('}')) {
+                    m_state = State::Done;
+
+                    if (!m_hasVersion || !m_hasTokens) {
+                        return Err("invalid structure");
+                    }
+
+                    this->skipWhitespace();
+                    if (m_pos != m_data.size()) {
+                        return Err("trailing data after offset {}", m_pos);
+                    }
+
+                    return Ok(false);
+                }
+
+                if (!m_first) {
+                    GEODE_UNWRAP(this->expect(','));
+                }
+                m_first = false;
+
+                GEODE_UNWRAP(this->readString(m_key));
+                GEODE_UNWRAP(this->expect(':'));
+
+                if (m_key == "_ver") {
+                    bool ok;
+                    GEODE_UNWRAP_INTO(auto ver, this->readInt(ok));
+                    if (!ok) return Err("invalid structure");
+
+                    m_version = static_cast<uint64_t>(ver);
+                    m_hasVersion = true;
+                } else if (m_key == "tokens") {
+                    if (!this->consume('[')) return Err("invalid structure");
+
+                    m_state = State::Tokens;
+                    m_hasTokens = true;
+                    m_first = true;
+                } else {
+                    GEODE_UNWRAP(this->skipValue());
+                }
+
+                break;
+            }
+
+            case State::Tokens: {
+                if (this->consume(']')) {
+                    m_state = State::Root;
+                    m_first = false;
+                    break;
+                }
+
+                if (!m_first) {
+                    GEODE_UNWRAP(this->expect(','));
+                }
+                m_first = false;
+
+                this->skipWhitespace();
+                if (m_pos < m_data.size() && m_data[m_pos] != '{') {
+                    // not an object, the DOM loader used to turn these into empty entries
+                    GEODE_UNWRAP(this->skipValue());
+                    out = StoredToken{};
+                    return Ok(true);
+                }
+
+                GEODE_UNWRAP(this->readEntry(out));
+                return Ok(true);
+            }
+
+            case State::Done:
+                return Ok(false);
+        }
+    }
+}
+
+geode::Result<std::optional<StoredToken>> TokenFileReader::find(std::string_view data, TokenKeyView key) {
+    TokenFileReader reader{data};
+    StoredToken entry;
+
+    while (true) {
+        GEODE_UNWRAP_INTO(bool more, reader.next(entry));
+        if (!more) break;
+
+        if (entry.accountId == key.accountId && entry.userId == key.userId && entry.url == key.url) {
+            return Ok(std::move(entry));
+        }
+    }
+
+    return Ok(std::nullopt);
+}
+
+}
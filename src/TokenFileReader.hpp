@@ -0,0 +1,55 @@
+#pragma once
+#include "TokenIndex.hpp"
+
+#include <Geode/Result.hpp>
+#include <optional>
+#include <string_view>
+
+namespace argon {
+
+// Streaming reader for the JSON token storage (`{"_ver": N, "tokens": [{...}, ...]}`).
+// Entries are decoded one at a time straight into a `StoredToken`, without building a DOM of the whole file,
+// so a lookup can stop at the first match and a full load never holds the file in two forms at once.
+class TokenFileReader {
+public:
+    explicit TokenFileReader(std::string_view data);
+
+    // Reads the next entry of the `tokens` array into `out`, reusing its buffers.
+    // Returns false once the end of the file is reached, at which point the structure has been fully validated.
+    geode::Result<bool> next(StoredToken& out);
+
+    // Value of `_ver`, only valid once it was read (it comes before the tokens in every file Argon writes)
+    uint64_t version() const;
+
+    // Scans for the token with this key, stopping at the first match
+    static geode::Result<std::optional<StoredToken>> find(std::string_view data, TokenKeyView key);
+
+private:
+    enum class State {
+        Start,
+        Root,
+        Tokens,
+        Done,
+    };
+
+    std::string_view m_data;
+    size_t m_pos = 0;
+    State m_state = State::Start;
+    bool m_first = true;
+    bool m_hasVersion = false;
+    bool m_hasTokens = false;
+    uint64_t m_version = 0;
+    std::string m_key;
+
+    void skipWhitespace();
+    bool consume(char c);
+    geode::Result<> expect(char c);
+    geode::Result<> readString(std::string& out);
+    geode::Result<> skipString();
+    // Reads an integer, sets `ok` to false (and skips it) if the value is not an integer
+    geode::Result<int64_t> readInt(bool& ok);
+    geode::Result<> skipValue();
+    geode::Result<> readEntry(StoredToken& out);
+};
+
+}
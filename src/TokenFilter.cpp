@@ -0,0 +1,95 @@
+#include "TokenFilter.hpp"
+
+#include <bit>
+#include <functional>
+
+using enum std::memory_order;
+
+namespace argon {
+
+static uint64_t mix(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hashKey(std::string_view url, int accountId) {
+    return mix(std::hash<std::string_view>{}(url) ^ mix(static_cast<uint32_t>(accountId)));
+}
+
+TokenFilter::TokenFilter(size_t expectedEntries) {
+    // ~64 bits per entry keeps the false positive rate well below 0.01% even when over the expected size
+    size_t bits = std::bit_ceil(std::max<size_t>(expectedEntries * 64, 1024));
+    size_t words = bits / 64;
+
+    m_words = std::make_unique<std::atomic<uint64_t>[]>(words);
+    m_mask = bits - 1;
+}
+
+bool TokenFilter::definitelyMissing(std::string_view url, int accountId, uint64_t tagA, uint64_t tagB) const {
+    uint64_t seq = m_seq.load(acquire);
+    if (seq & 1) {
+        return false;
+    }
+
+    bool missing = m_tagA.load(relaxed) == tagA && m_tagB.load(relaxed) == tagB;
+
+    if (missing) {
+        uint64_t h = hashKey(url, accountId);
+        uint64_t h1 = h, h2 = (h >> 32) | 1;
+
+        missing = false;
+        for (size_t i = 0; i < HASH_COUNT; i++) {
+            size_t bit = (h1 + i * h2) & m_mask;
+            if (!(m_words[bit / 64].load(relaxed) & (1ull << (bit % 64)))) {
+                missing = true;
+                break;
+            }
+        }
+    }
+
+    std::atomic_thread_fence(acquire);
+    return missing && m_seq.load(relaxed) == seq;
+}
+
+void TokenFilter::insert(std::string_view url, int accountId) {
+    uint64_t h = hashKey(url, accountId);
+    uint64_t h1 = h, h2 = (h >> 32) | 1;
+
+    for (size_t i = 0; i < HASH_COUNT; i++) {
+        size_t bit = (h1 + i * h2) & m_mask;
+        m_words[bit / 64].fetch_or(1ull << (bit % 64), relaxed);
+    }
+}
+
+void TokenFilter::beginUpdate() {
+    uint64_t seq = m_seq.load(relaxed);
+    if (!(seq & 1)) {
+        m_seq.store(seq + 1, relaxed);
+        std::atomic_thread_fence(release);
+    }
+}
+
+void TokenFilter::clear() {
+    for (size_t i = 0; i <= m_mask / 64; i++) {
+        m_words[i].store(0, relaxed);
+    }
+}
+
+void TokenFilter::setTags(uint64_t tagA, uint64_t tagB) {
+    m_tagA.store(tagA, relaxed);
+    m_tagB.store(tagB, relaxed);
+}
+
+void TokenFilter::endUpdate() {
+    uint64_t seq = m_seq.load(relaxed);
+    if (seq & 1) {
+        m_seq.store(seq + 1, release);
+    }
+}
+
+}
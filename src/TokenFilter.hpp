@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <stdint.h>
+
+namespace argon {
+
+// Bloom filter over (server url, account ID), used to answer lookups for accounts without tokens without taking any locks.
+//
+// Reads are lock-free and may run concurrently with writes. Writers must be serialized externally (e.g. by the config lock).
+// Adding entries is always safe, anything that removes bits has to happen between `beginUpdate` and `endUpdate`,
+// during which readers are told that the filter can't be trusted (seqlock).
+// Every update also records two tags, describing the state of the storage that the filter was built from.
+class TokenFilter {
+public:
+    explicit TokenFilter(size_t expectedEntries);
+
+    TokenFilter(const TokenFilter&) = delete;
+    TokenFilter& operator=(const TokenFilter&) = delete;
+
+    // Whether there is definitely no entry for this account, as of the storage state described by the tags.
+    // Returns false if there might be one, if the tags don't match, or if the filter is being updated or was never built.
+    bool definitelyMissing(std::string_view url, int accountId, uint64_t tagA, uint64_t tagB) const;
+
+    void insert(std::string_view url, int accountId);
+
+    void beginUpdate();
+    void clear();
+    void setTags(uint64_t tagA, uint64_t tagB);
+    void endUpdate();
+
+private:
+    static constexpr size_t HASH_COUNT = 4;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+    size_t m_mask;
+    // odd while an update is in progress, starts odd as the filter is empty until it's first built
+    std::atomic<uint64_t> m_seq = 1;
+    std::atomic<uint64_t> m_tagA = 0;
+    std::atomic<uint64_t> m_tagB = 0;
+};
+
+}
@@ -0,0 +1,104 @@
+#include "TokenIndex.hpp"
+
+namespace argon {
+
+static uint64_t userKey(int accountId, int userId) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(accountId)) << 32) | static_cast<uint32_t>(userId);
+}
+
+TokenIndex::Shard* TokenIndex::shard(std::string_view url) {
+    auto it = m_shards.find(url);
+    return it == m_shards.end() ? nullptr : &it->second;
+}
+
+const TokenIndex::Shard* TokenIndex::shard(std::string_view url) const {
+    auto it = m_shards.find(url);
+    return it == m_shards.end() ? nullptr : &it->second;
+}
+
+const StoredToken* TokenIndex::find(TokenKeyView key) const {
+    auto shard = this->shard(key.url);
+    if (!shard) {
+        return nullptr;
+    }
+
+    auto it = shard->tokens.find(userKey(key.accountId, key.userId));
+    return it == shard->tokens.end() ? nullptr : &it->second;
+}
+
+bool TokenIndex::upsert(StoredToken token) {
+    auto shard = this->shard(token.url);
+    if (!shard) {
+        shard = &m_shards[token.url];
+    }
+
+    auto [it, inserted] = shard->tokens.insert_or_assign(userKey(token.accountId, token.userId), std::move(token));
+    if (inserted) {
+        m_size++;
+    }
+
+    return inserted;
+}
+
+bool TokenIndex::erase(TokenKeyView key) {
+    auto shard = this->shard(key.url);
+    if (!shard || shard->tokens.erase(userKey(key.accountId, key.userId)) == 0) {
+        return false;
+    }
+
+    m_size--;
+    return true;
+}
+
+size_t TokenIndex::eraseAccount(std::string_view url, int accountId) {
+    auto shard = this->shard(url);
+    if (!shard) {
+        shard = &m_shards[std::string{url}];
+    }
+
+    if (!shard->masked) {
+        shard->maskedAccounts.insert(accountId);
+    }
+
+    size_t count = std::erase_if(shard->tokens, [&](auto& pair) {
+        return pair.second.accountId == accountId;
+    });
+
+    m_size -= count;
+    return count;
+}
+
+size_t TokenIndex::eraseServer(std::string_view url) {
+    auto shard = this->shard(url);
+    if (!shard) {
+        shard = &m_shards[std::string{url}];
+    }
+
+    size_t count = shard->tokens.size();
+    shard->tokens.clear();
+    shard->maskedAccounts.clear();
+    shard->masked = true;
+
+    m_size -= count;
+    return count;
+}
+
+void TokenIndex::reset() {
+    m_shards.clear();
+    m_size = 0;
+}
+
+bool TokenIndex::masks(TokenKeyView key) const {
+    auto shard = this->shard(key.url);
+    return shard && (shard->masked || shard->maskedAccounts.contains(key.accountId));
+}
+
+size_t TokenIndex::size() const {
+    return m_size;
+}
+
+bool TokenIndex::empty() const {
+    return m_size == 0;
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace argon {
+
+struct StoredToken {
+    std::string url;
+    int accountId = 0;
+    int userId = 0;
+    std::string name;
+    std::string ident;
+    std::string token;
+    // unix timestamps in seconds, 0 if unknown (e.g. the token was stored by an older Argon version)
+    int64_t createdAt = 0;
+    int64_t lastUsedAt = 0;
+};
+
+// Non-owning version of `StoredToken`, e.g. pointing into a mapped binary store
+struct TokenView {
+    std::string_view url;
+    int accountId = 0;
+    int userId = 0;
+    std::string_view name;
+    std::string_view ident;
+    std::string_view token;
+    int64_t createdAt = 0;
+    int64_t lastUsedAt = 0;
+};
+
+inline TokenView toView(const StoredToken& token) {
+    return { token.url, token.accountId, token.userId, token.name, token.ident, token.token, token.createdAt, token.lastUsedAt };
+}
+
+inline StoredToken toStored(const TokenView& token) {
+    return {
+        std::string{token.url}, token.accountId, token.userId,
+        std::string{token.name}, std::string{token.ident}, std::string{token.token},
+        token.createdAt, token.lastUsedAt
+    };
+}
+
+struct TokenKeyView {
+    std::string_view url;
+    int accountId;
+    int userId;
+};
+
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const {
+        return std::hash<std::string_view>{}(str);
+    }
+};
+
+// Hash index of stored tokens, keyed on (server url, account ID, user ID) and partitioned into one shard per server,
+// so that operations on a single server never touch the tokens of other servers.
+// Lookups, upserts and erases are O(1), erasing by account or by server is O(number of tokens of that server).
+//
+// The index can be layered on top of an immutable store, in which case erased accounts and servers
+// mask the entries of the lower layer, see `masks`.
+class TokenIndex {
+public:
+    TokenIndex() = default;
+    TokenIndex(const TokenIndex&) = delete;
+    TokenIndex& operator=(const TokenIndex&) = delete;
+    TokenIndex(TokenIndex&&) = default;
+    TokenIndex& operator=(TokenIndex&&) = default;
+
+    const StoredToken* find(TokenKeyView key) const;
+
+    // Inserts the token or replaces the one with the same key, returns whether a new entry was created
+    bool upsert(StoredToken token);
+
+    bool erase(TokenKeyView key);
+    // Erases the tokens of this account on this server
+    size_t eraseAccount(std::string_view url, int accountId);
+    size_t eraseServer(std::string_view url);
+    // Drops all entries and forgets about erased accounts and servers
+    void reset();
+
+    // Whether an entry with this key in a lower layer was erased
+    bool masks(TokenKeyView key) const;
+
+    size_t size() const;
+    bool empty() const;
+
+    template <typename F>
+    void forEach(F&& func) const {
+        for (auto& [_, shard] : m_shards) {
+            for (auto& [_, token] : shard.tokens) {
+                func(token);
+            }
+        }
+    }
+
+private:
+    struct Shard {
+        // keyed on (account ID, user ID)
+        std::unordered_map<uint64_t, StoredToken> tokens;
+        std::unordered_set<int> maskedAccounts;
+        bool masked = false;
+    };
+
+    std::unordered_map<std::string, Shard, StringHash, std::equal_to<>> m_shards;
+    size_t m_size = 0;
+
+    Shard* shard(std::string_view url);
+    const Shard* shard(std::string_view url) const;
+};
+
+}
@@ -0,0 +1,346 @@
+#include "TokenJournal.hpp"
+#include "FileIO.hpp"
+
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+using geode::Ok;
+using geode::Err;
+
+namespace argon {
+
+static constexpr std::array<uint8_t, 4> JOURNAL_MAGIC = {'A', 'R', 'G', 'J'};
+
+static constexpr auto CRC_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+
+    return table;
+}();
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffffu;
+
+    for (size_t i = 0; i < size; i++) {
+        crc = CRC_TABLE[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffffu;
+}
+
+namespace {
+
+struct Writer {
+    std::vector<uint8_t> buf;
+
+    void u8(uint8_t v) {
+        buf.push_back(v);
+    }
+
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            buf.push_back(static_cast<uint8_t>(v >> (i * 8)));
+        }
+    }
+
+    void i32(int32_t v) {
+        this->u32(static_cast<uint32_t>(v));
+    }
+
+    void i64(int64_t v) {
+        this->u32(static_cast<uint32_t>(v));
+        this->u32(static_cast<uint32_t>(static_cast<uint64_t>(v) >> 32));
+    }
+
+    void str(std::string_view s) {
+        this->u32(static_cast<uint32_t>(s.size()));
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+};
+
+struct Reader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+
+    bool u8(uint8_t& out) {
+        if (size - pos < 1) return false;
+        out = data[pos++];
+        return true;
+    }
+
+    bool u32(uint32_t& out) {
+        if (size - pos < 4) return false;
+
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            out |= static_cast<uint32_t>(data[pos++]) << (i * 8);
+        }
+
+        return true;
+    }
+
+    bool i32(int& out) {
+        uint32_t v;
+        if (!this->u32(v)) return false;
+        out = static_cast<int32_t>(v);
+        return true;
+    }
+
+    bool i64(int64_t& out) {
+        uint32_t lo, hi;
+        if (!this->u32(lo) || !this->u32(hi)) return false;
+        out = static_cast<int64_t>((static_cast<uint64_t>(hi) << 32) | lo);
+        return true;
+    }
+
+    bool str(std::string& out) {
+        uint32_t len;
+        if (!this->u32(len) || size - pos < len) return false;
+
+        out.assign(reinterpret_cast<const char*>(data + pos), len);
+        pos += len;
+        return true;
+    }
+};
+
+bool readToken(Reader& r, StoredToken& token) {
+    return r.i32(token.accountId)
+        && r.i32(token.userId)
+        && r.str(token.url)
+        && r.str(token.name)
+        && r.str(token.ident)
+        && r.str(token.token)
+        && r.i64(token.createdAt)
+        && r.i64(token.lastUsedAt);
+}
+
+}
+
+bool TokenJournal::apply(TokenIndex& index, std::span<const uint8_t> payload) {
+    Reader r{payload.data(), payload.size()};
+
+    uint8_t op;
+    if (!r.u8(op)) return false;
+
+    switch (static_cast<JournalOp>(op)) {
+        case JournalOp::Upsert:
+        case JournalOp::Touch: {
+            StoredToken token;
+            if (!readToken(r, token)) {
+                return false;
+            }
+
+            index.upsert(std::move(token));
+            return true;
+        }
+
+        case JournalOp::EraseServerAccount: {
+            std::string url;
+            int accountId;
+            if (!r.str(url) || !r.i32(accountId)) return false;
+
+            index.eraseAccount(url, accountId);
+            return true;
+        }
+
+        case JournalOp::EraseServer: {
+            std::string url;
+            if (!r.str(url)) return false;
+
+            index.eraseServer(url);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+TokenJournal::TokenJournal(std::filesystem::path path) : m_path(std::move(path)) {}
+
+const std::filesystem::path& TokenJournal::path() const {
+    return m_path;
+}
+
+template <typename F>
+geode::Result<TokenJournal::Scan> TokenJournal::scan(uint64_t offset, F&& func) const {
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file) {
+        // no journal yet
+        return Ok(Scan{0, false});
+    }
+
+    if (offset == 0) {
+        std::array<uint8_t, HEADER_SIZE> header;
+        if (!file.read(reinterpret_cast<char*>(header.data()), header.size())) {
+            // empty or torn header, it will be rewritten on the next append
+            return Ok(Scan{0, false});
+        }
+
+        if (!std::equal(JOURNAL_MAGIC.begin(), JOURNAL_MAGIC.end(), header.begin())) {
+            return Err("journal has an invalid header");
+        }
+
+        uint32_t version;
+        Reader{header.data(), header.size(), JOURNAL_MAGIC.size()}.u32(version);
+        if (version != VERSION) {
+            return Err("unsupported journal version {}", version);
+        }
+
+        offset = HEADER_SIZE;
+    } else {
+        file.seekg(offset);
+    }
+
+    // only the records past `offset` are read, so catching up with appends from other mods is cheap
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    file.close();
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        Reader r{data.data(), data.size(), pos};
+
+        uint32_t size, checksum;
+        if (!r.u32(size) || !r.u32(checksum) || data.size() - r.pos < size) {
+            break;
+        }
+
+        const uint8_t* payload = data.data() + r.pos;
+        if (crc32(payload, size) != checksum || !func(std::span<const uint8_t>{payload, size})) {
+            break;
+        }
+
+        pos = r.pos + size;
+    }
+
+    return Ok(Scan{offset + pos, pos < data.size()});
+}
+
+geode::Result<uint64_t> TokenJournal::replay(TokenIndex& index, uint64_t offset) {
+    GEODE_UNWRAP_INTO(auto res, this->scan(offset, [&](std::span<const uint8_t> payload) {
+        return apply(index, payload);
+    }));
+
+    if (res.corrupted) {
+        std::error_code ec;
+        std::filesystem::resize_file(m_path, res.end, ec);
+        if (ec) {
+            return Err("failed to truncate corrupted journal: {}", ec.message());
+        }
+    }
+
+    return Ok(res.end);
+}
+
+geode::Result<std::vector<StoredToken>> TokenJournal::storedTokens() const {
+    TokenIndex index;
+    std::vector<StoredToken> stored;
+
+    GEODE_UNWRAP(this->scan(0, [&](std::span<const uint8_t> payload) {
+        if (!apply(index, payload)) {
+            return false;
+        }
+
+        // `apply` already made sure that the payload is well formed
+        if (static_cast<JournalOp>(payload[0]) == JournalOp::Upsert) {
+            Reader r{payload.data(), payload.size(), 1};
+            readToken(r, stored.emplace_back());
+        }
+
+        return true;
+    }));
+
+    // only the latest version of each token counts, and only if no later record erased it
+    std::vector<StoredToken> out;
+    for (auto& token : stored) {
+        auto latest = index.find({token.url, token.accountId, token.userId});
+        if (!latest) continue;
+
+        bool seen = std::ranges::any_of(out, [&](const StoredToken& other) {
+            return other.accountId == token.accountId && other.userId == token.userId && other.url == token.url;
+        });
+
+        if (!seen) {
+            out.push_back(*latest);
+        }
+    }
+
+    return Ok(std::move(out));
+}
+
+std::vector<uint8_t> TokenJournal::encodeUpsert(const StoredToken& token) {
+    Writer w;
+    w.u8(static_cast<uint8_t>(JournalOp::Upsert));
+    w.i32(token.accountId);
+    w.i32(token.userId);
+    w.str(token.url);
+    w.str(token.name);
+    w.str(token.ident);
+    w.str(token.token);
+    w.i64(token.createdAt);
+    w.i64(token.lastUsedAt);
+
+    return std::move(w.buf);
+}
+
+std::vector<uint8_t> TokenJournal::encodeTouch(const StoredToken& token) {
+    auto buf = encodeUpsert(token);
+    buf[0] = static_cast<uint8_t>(JournalOp::Touch);
+    return buf;
+}
+
+std::vector<uint8_t> TokenJournal::encodeEraseAccount(std::string_view url, int accountId) {
+    Writer w;
+    w.u8(static_cast<uint8_t>(JournalOp::EraseServerAccount));
+    w.str(url);
+    w.i32(accountId);
+
+    return std::move(w.buf);
+}
+
+std::vector<uint8_t> TokenJournal::encodeEraseServer(std::string_view url) {
+    Writer w;
+    w.u8(static_cast<uint8_t>(JournalOp::EraseServer));
+    w.str(url);
+
+    return std::move(w.buf);
+}
+
+geode::Result<> TokenJournal::reset(bool sync) {
+    Writer w;
+    w.buf.assign(JOURNAL_MAGIC.begin(), JOURNAL_MAGIC.end());
+    w.u32(VERSION);
+
+    return writeFileAtomic(m_path, w.buf, sync);
+}
+
+geode::Result<size_t> TokenJournal::append(std::span<const std::vector<uint8_t>> payloads, bool sync) {
+    std::error_code ec;
+    if (std::filesystem::file_size(m_path, ec) < HEADER_SIZE || ec) {
+        GEODE_UNWRAP(this->reset(sync));
+    }
+
+    // build all the records first, so they're written with a single call
+    Writer w;
+    for (auto& payload : payloads) {
+        w.u32(static_cast<uint32_t>(payload.size()));
+        w.u32(crc32(payload.data(), payload.size()));
+        w.buf.insert(w.buf.end(), payload.begin(), payload.end());
+    }
+
+    GEODE_UNWRAP(appendToFile(m_path, w.buf, sync));
+
+    return Ok(w.buf.size());
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "TokenIndex.hpp"
+
+#include <Geode/Result.hpp>
+#include <filesystem>
+#include <span>
+#include <stdint.h>
+
+namespace argon {
+
+enum class JournalOp : uint8_t {
+    Upsert = 1,
+    EraseServerAccount = 2,
+    EraseServer = 3,
+    // same payload as `Upsert`, for updating the last use time of a token that was already stored
+    Touch = 4,
+};
+
+// Append-only log of token mutations, stored next to the JSON snapshot.
+//
+// Layout: an 8 byte header ("ARGJ" + u32 format version), followed by records of
+// `[u32 payload size][u32 crc32 of payload][payload]`, all integers little endian.
+// The payload starts with a `JournalOp` byte, followed by the fields of that operation.
+class TokenJournal {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t HEADER_SIZE = 8;
+
+    explicit TokenJournal(std::filesystem::path path);
+
+    const std::filesystem::path& path() const;
+
+    // Applies all records starting at `offset` (0 to read from the beginning) to the index,
+    // returns the offset right past the last valid record. A torn or corrupted tail (e.g. left by a crash)
+    // is cut off, so that further appends land right after valid data.
+    geode::Result<uint64_t> replay(TokenIndex& index, uint64_t offset);
+
+    // Tokens that were stored by a record (not just touched) and are still there after all records are applied,
+    // i.e. the ones that only exist in the journal if it started out empty
+    geode::Result<std::vector<StoredToken>> storedTokens() const;
+
+    // Encodes the payload of a single record
+    static std::vector<uint8_t> encodeUpsert(const StoredToken& token);
+    static std::vector<uint8_t> encodeTouch(const StoredToken& token);
+    static std::vector<uint8_t> encodeEraseAccount(std::string_view url, int accountId);
+    static std::vector<uint8_t> encodeEraseServer(std::string_view url);
+
+    // Applies an encoded record to the index, returns false if the payload is malformed
+    static bool apply(TokenIndex& index, std::span<const uint8_t> payload);
+
+    // Appends all the records with a single write, returns the amount of bytes written
+    geode::Result<size_t> append(std::span<const std::vector<uint8_t>> payloads, bool sync);
+
+    // Drops all records, called after their contents were written into a snapshot.
+    geode::Result<> reset(bool sync);
+
+private:
+    std::filesystem::path m_path;
+
+    struct Scan {
+        // offset right past the last valid record
+        uint64_t end;
+        // whether anything follows it, e.g. a torn write
+        bool corrupted;
+    };
+
+    // Calls `func` with the payload of every valid record starting at `offset`, until it returns false
+    template <typename F>
+    geode::Result<Scan> scan(uint64_t offset, F&& func) const;
+};
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "SharedTokenCache.hpp"
+
+#include <arc/sync/Notify.hpp>
+
+namespace argon {
+
+// Wakes up a task that waits for something another thread (or Argon copy) does, without it having to poll.
+// Whoever is handed the waker calls it under their own lock, and never again once it was unregistered,
+// so the waiting task only has to unregister before this is destroyed
+class Wakeup {
+public:
+    Wakeup() = default;
+    Wakeup(const Wakeup&) = delete;
+    Wakeup& operator=(const Wakeup&) = delete;
+
+    AbiWaker waker() {
+        return { &Wakeup::wakeAbi, this };
+    }
+
+    void wake() {
+        // stores a permit if the task isn't waiting yet, so a wakeup between checking and waiting is never lost
+        m_notify.notifyOne();
+    }
+
+    // Resolves once woken up, immediately if that already happened since the last wait
+    auto wait() {
+        return m_notify.notified();
+    }
+
+private:
+    arc::Notify m_notify;
+
+    static void wakeAbi(void* ctx) {
+        static_cast<Wakeup*>(ctx)->wake();
+    }
+};
+
+}
@@ -6,6 +6,7 @@
 #endif
 #include <Geode/loader/Mod.hpp>
 #include <asp/iter.hpp>
+#include <array>
 
 using namespace arc;
 
@@ -51,7 +52,14 @@ g_urlOffset;
 
 static_assert(g_urlOffset.valid, "Unsupported GD version");
 
-std::string getBaseServerUrl() {
+static bool isAmazonStore() {
+    return false
+        GEODE_ANDROID(|| !((GJMoreGamesLayer* volatile)nullptr)->getMoreGamesList()->count() );
+}
+
+// Reads the url from the game, private server mods can patch it at runtime.
+// Main thread only, on Android this goes through the game's UI classes
+static std::string detectBaseServerUrl() {
     // TODO: server api stuff
     // if (Loader::get()->isModLoaded("km7dev.server_api")) {
     //     auto url = ServerAPIEvents::getCurrentServer().url;
@@ -66,10 +74,7 @@ std::string getBaseServerUrl() {
 
     // This was taken from the impostor mod :) and altered
 
-    bool isAmazonStore = false
-        GEODE_ANDROID(|| !((GJMoreGamesLayer* volatile)nullptr)->getMoreGamesList()->count() );
-
-    std::string ret = g_urlOffset.addr(isAmazonStore);
+    std::string ret = g_urlOffset.addr(isAmazonStore());
 
     if(ret.size() > 34) ret = ret.substr(0, 34);
 
@@ -77,12 +82,76 @@ std::string getBaseServerUrl() {
         ret.pop_back();
     }
 
-    if (!ret.starts_with("http")) {
-        log::error("(Argon) the base server URL does not appear to be valid: '{}'", ret);
-        log::error("(Argon) the offset may be invalid, we used base + {:x} (alt: {})", isAmazonStore ? g_urlOffset.alt : g_urlOffset.value, isAmazonStore);
+    return ret;
+}
+
+namespace {
+
+// GD endpoints used for verification
+enum class GDEndpoint {
+    UploadMessage,
+    DeleteMessages,
+    GetMessages,
+    GetUserList,
+};
+
+constexpr std::array<std::string_view, 4> GD_ENDPOINT_PATHS = {
+    "uploadGJMessage20.php",
+    "deleteGJMessages20.php",
+    "getGJMessages20.php",
+    "getGJUserList20.php",
+};
+
+// Full urls of the GD endpoints, for a single GD server
+struct GDEndpoints {
+    std::string base;
+    std::array<std::string, GD_ENDPOINT_PATHS.size()> urls;
+
+    static std::string format(std::string_view base, GDEndpoint endpoint) {
+        return fmt::format("{}/{}", base, GD_ENDPOINT_PATHS[static_cast<size_t>(endpoint)]);
     }
 
-    return ret;
+    static GDEndpoints build(std::string base) {
+        GDEndpoints out{.base = std::move(base)};
+        for (size_t i = 0; i < out.urls.size(); i++) {
+            out.urls[i] = format(out.base, static_cast<GDEndpoint>(i));
+        }
+
+        return out;
+    }
+};
+
+}
+
+// endpoints of the server the game talks to, published on the main thread and only rebuilt when its url changes
+static Published<GDEndpoints> g_baseEndpoints;
+
+std::string refreshBaseServerUrl() {
+    auto url = detectBaseServerUrl();
+
+    auto current = g_baseEndpoints.load();
+    if (current && current->base == url) {
+        return url;
+    }
+
+    if (!url.starts_with("http")) {
+        bool amazon = isAmazonStore();
+        log::error("(Argon) the base server URL does not appear to be valid: '{}'", url);
+        log::error("(Argon) the offset may be invalid, we used base + {:x} (alt: {})", amazon ? g_urlOffset.alt : g_urlOffset.value, amazon);
+    }
+
+    g_baseEndpoints.publish(std::make_unique<GDEndpoints>(GDEndpoints::build(url)));
+    return url;
+}
+
+// Returns the url of an endpoint of the account's GD server, only formatted if it isn't the one the game uses
+static std::string gdEndpoint(const AccountData& account, GDEndpoint endpoint) {
+    auto base = g_baseEndpoints.load();
+    if (base && account.serverUrl == base->base) {
+        return base->urls[static_cast<size_t>(endpoint)];
+    }
+
+    return GDEndpoints::format(account.serverUrl, endpoint);
 }
 
 static const char* platformString() {
@@ -141,7 +210,7 @@ Result<WebResponse> wrapResponse(std::string_view what, WebResponse response) {
 }
 
 Future<Result<Stage1ResponseData>> startChallenge(const AccountData& account, std::string_view preferredMethod, bool forceStrong) {
-    auto& argon = ArgonState::get();
+    auto& config = ArgonState::get().serverConfig();
 
     auto payload = matjson::makeObject({
         {"accountId", account.accountId},
@@ -152,19 +221,19 @@ Future<Result<Stage1ResponseData>> startChallenge(const AccountData& account, st
         {"preferred", preferredMethod}
     });
 
-    auto url = argon.makeUrl("v1/challenge/start");
+    auto& url = config.challengeStartUrl;
     log::debug("(Argon) requesting challenge with url: {}", url);
 
     auto response = co_await baseRequest()
         .bodyJSON(payload)
-        .post(std::move(url));
+        .post(url);
 
     ARC_CO_UNWRAP_INTO(response, wrapResponse("challenge start", std::move(response)));
     co_return extractData<Stage1ResponseData>(response);
 }
 
-static Future<VerifyResult> verifyChallengeInner(const AccountData& account, uint32_t challengeId, std::string_view solution, std::string path) {
-    auto& argon = ArgonState::get();
+// `url` is one of the endpoints in `ServerConfig`, which stay valid forever
+static Future<VerifyResult> verifyChallengeInner(const AccountData& account, uint32_t challengeId, std::string_view solution, const std::string& url) {
 
     auto payload = matjson::makeObject({
         {"challengeId", challengeId},
@@ -174,7 +243,7 @@ static Future<VerifyResult> verifyChallengeInner(const AccountData& account, uin
 
     auto response = co_await baseRequest()
         .bodyJSON(payload)
-        .post(argon.makeUrl(path));
+        .post(url);
     ARC_CO_UNWRAP_INTO(response, wrapResponse("challenge verify", std::move(response)));
     ARC_CO_UNWRAP_INTO(auto data, extractData<matjson::Value>(response));
 
@@ -197,11 +266,11 @@ static Future<VerifyResult> verifyChallengeInner(const AccountData& account, uin
 }
 
 Future<VerifyResult> verifyChallenge(const AccountData& account, uint32_t challengeId, std::string_view solution) {
-    return verifyChallengeInner(account, challengeId, solution, "v1/challenge/verify");
+    return verifyChallengeInner(account, challengeId, solution, ArgonState::get().serverConfig().challengeVerifyUrl);
 }
 
 Future<VerifyResult> verifyChallengePoll(const AccountData& account, uint32_t challengeId, std::string_view solution) {
-    return verifyChallengeInner(account, challengeId, solution, "v1/challenge/verifypoll");
+    return verifyChallengeInner(account, challengeId, solution, ArgonState::get().serverConfig().challengeVerifyPollUrl);
 }
 
 Future<Result<>> submitGDMessage(const AccountData& account, int target, std::string_view message) {
@@ -214,7 +283,7 @@ Future<Result<>> submitGDMessage(const AccountData& account, int target, std::st
 
     auto response = co_await baseGDRequest()
         .bodyString(payload)
-        .post(fmt::format("{}/uploadGJMessage20.php", account.serverUrl));
+        .post(gdEndpoint(account, GDEndpoint::UploadMessage));
     ARC_CO_UNWRAP_INTO(response, wrapResponse("GD message", std::move(response)));
 
     auto res = response.string().unwrapOrDefault();
@@ -235,7 +304,7 @@ Future<Result<>> deleteGDMessage(const AccountData& account, int id) {
     // delete the message
     auto response = co_await baseGDRequest()
         .bodyString(payload)
-        .post(fmt::format("{}/deleteGJMessages20.php", account.serverUrl));
+        .post(gdEndpoint(account, GDEndpoint::DeleteMessages));
 
     ARC_CO_UNWRAP_INTO(response, wrapResponse("delete GD message", std::move(response)));
 
@@ -255,7 +324,7 @@ Future<Result<>> checkGDMessageLimit(const AccountData& account) {
 
     auto response = co_await baseGDRequest()
         .bodyString(payload)
-        .post(fmt::format("{}/getGJMessages20.php", account.serverUrl));
+        .post(gdEndpoint(account, GDEndpoint::GetMessages));
 
     ARC_CO_UNWRAP_INTO(response, wrapResponse("fetch GD messages", std::move(response)));
     auto str = response.string().unwrapOrDefault();
@@ -288,7 +357,7 @@ Future<Result<>> checkGDUserNotBlocked(const AccountData& account, int targetUse
 
     auto response = co_await baseGDRequest()
         .bodyString(payload)
-        .post(fmt::format("{}/getGJUserList20.php", account.serverUrl));
+        .post(gdEndpoint(account, GDEndpoint::GetUserList));
 
     ARC_CO_UNWRAP_INTO(response, wrapResponse("fetch GD blocklist", std::move(response)));
     auto str = response.string().unwrapOrDefault();
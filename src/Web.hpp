@@ -5,7 +5,9 @@
 
 namespace argon::web {
 
-std::string getBaseServerUrl();
+// Reads the url of the GD server from the game and publishes it for requests, which never look at the game themselves.
+// Main thread only
+std::string refreshBaseServerUrl();
 
 struct SuccessfulVerification {
     std::string authtoken;
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <cocos2d.h>
+#include <atomic>
+#include <memory>
 #include <utility>
 #include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 namespace argon {
 
@@ -58,5 +62,28 @@ public:
 };
 
 using CCMutex = CCData<std::mutex>;
+using CCSharedMutex = CCData<std::shared_mutex>;
+
+// Immutable value that is read lock-free and replaced as a whole. Replaced values are kept alive
+// until this is destroyed (at exit for statics), as readers could still be using them, so only use it for rarely changing values
+template <typename T>
+class Published {
+public:
+    // nullptr until the first `publish`
+    const T* load() const {
+        return m_current.load(std::memory_order::acquire);
+    }
+
+    void publish(std::unique_ptr<T> value) {
+        std::lock_guard lock(m_mutex);
+        m_current.store(value.get(), std::memory_order::release);
+        m_values.push_back(std::move(value));
+    }
+
+private:
+    std::atomic<const T*> m_current = nullptr;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<T>> m_values;
+};
 
 }